@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Count the set bits in a 32 bit mask
+//
+// mask:	The mask to count
+//
+// Returns the number of set bits
+inline constexpr int popcount_32(uint32_t mask)
+{
+	mask = mask - ((mask >> 1) & 0x55555555u);
+	mask = (mask & 0x33333333u) + ((mask >> 2) & 0x33333333u);
+	mask = (mask + (mask >> 4)) & 0x0F0F0F0Fu;
+	return static_cast<int>((mask * 0x01010101u) >> 24);
+}
+
+// Count the set bits in a 64 bit mask
+//
+// mask:	The mask to count
+//
+// Returns the number of set bits
+inline constexpr int popcount_64(uint64_t mask)
+{
+	mask = mask - ((mask >> 1) & 0x5555555555555555ull);
+	mask = (mask & 0x3333333333333333ull) + ((mask >> 2) & 0x3333333333333333ull);
+	mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return static_cast<int>((mask * 0x0101010101010101ull) >> 56);
+}
+
+// Get the index of the lowest set bit
+//
+// mask:	The mask to search, must not be 0
+//
+// Returns the bit index
+inline int count_trailing_zeros_64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return static_cast<int>(index);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	if (_BitScanForward(&index, static_cast<unsigned long>(mask))) {
+		return static_cast<int>(index);
+	}
+	_BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+	return static_cast<int>(index) + 32;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
@@ -1,19 +1,193 @@
 #include "day_10.h"
 
 #include "../common_includes.h"
+#include "../bit_utils.h"
 
+#include <cstdint>
 #include <vector>
-#include <algorithm>
 
 PROBLEM_CLASS_CPP(10);
 
-// Store the adaptor voltage and the combinations that can be made from that number
-typedef std::pair<int, double> adaptor_combo;
+// The largest difference an adaptor can take
+static constexpr int MAX_JOLT_DIFFERENCE = 3;
+// Ways to reach a joltage and the 3 below it are kept in a ring of 4
+static constexpr int WAYS_RING_MASK = 3;
+
+// Unsigned integer that grows as needed, only supporting what counting arrangements needs
+class big_uint {
+public:
+	void set(uint32_t value);
+	void set_sum(const big_uint& a, const big_uint& b, const big_uint& c);
+	std::string to_string() const;
+
+private:
+	// Least significant limb first, with no leading zero limbs
+	std::vector<uint32_t> m_limbs;
+};
+
+// Set to a small value
+//
+// value:	The value to set
+void big_uint::set(uint32_t value)
+{
+	m_limbs.clear();
+	if (value != 0) {
+		m_limbs.push_back(value);
+	}
+}
+
+// Set to the sum of three values, reusing this number's storage
+//
+// a:	First value, must not be this
+// b:	Second value, must not be this
+// c:	Third value, must not be this
+void big_uint::set_sum(const big_uint& a, const big_uint& b, const big_uint& c)
+{
+	size_t num_limbs = a.m_limbs.size() > b.m_limbs.size() ? a.m_limbs.size() : b.m_limbs.size();
+	num_limbs = c.m_limbs.size() > num_limbs ? c.m_limbs.size() : num_limbs;
+	m_limbs.resize(num_limbs);
+
+	uint64_t carry = 0;
+	for (size_t i = 0; i < num_limbs; ++i) {
+		uint64_t sum = carry;
+		sum += i < a.m_limbs.size() ? a.m_limbs[i] : 0;
+		sum += i < b.m_limbs.size() ? b.m_limbs[i] : 0;
+		sum += i < c.m_limbs.size() ? c.m_limbs[i] : 0;
+		m_limbs[i] = static_cast<uint32_t>(sum);
+		carry = sum >> 32;
+	}
+	if (carry != 0) {
+		m_limbs.push_back(static_cast<uint32_t>(carry));
+	}
+}
+
+// Convert to decimal
+//
+// Returns the decimal string
+std::string big_uint::to_string() const
+{
+	static constexpr uint32_t DECIMAL_CHUNK = 1000000000;
+	static constexpr int DECIMAL_CHUNK_DIGITS = 9;
+
+	if (m_limbs.empty()) {
+		return "0";
+	}
+
+	// Repeatedly divide by 10^9, collecting the remainders from least significant up
+	std::vector<uint32_t> quotient(m_limbs);
+	std::vector<uint32_t> decimal_chunks;
+	while (!quotient.empty()) {
+		uint64_t remainder = 0;
+		for (size_t i = quotient.size(); i-- > 0;) {
+			const uint64_t cur = (remainder << 32) | quotient[i];
+			quotient[i] = static_cast<uint32_t>(cur / DECIMAL_CHUNK);
+			remainder = cur % DECIMAL_CHUNK;
+		}
+		decimal_chunks.push_back(static_cast<uint32_t>(remainder));
+		while (!quotient.empty() && quotient.back() == 0) {
+			quotient.pop_back();
+		}
+	}
+
+	std::string decimal = std::to_string(decimal_chunks.back());
+	for (size_t i = decimal_chunks.size() - 1; i-- > 0;) {
+		const std::string chunk = std::to_string(decimal_chunks[i]);
+		decimal.append(DECIMAL_CHUNK_DIGITS - chunk.size(), '0');
+		decimal.append(chunk);
+	}
+	return decimal;
+}
+
+// The adaptors in the bag as a bitmap over every joltage, which sorts them as they're added
+class adaptor_bag {
+public:
+	adaptor_bag(std::ifstream& input);
+
+	long long get_jolt_difference_product() const;
+	std::string get_num_arrangements() const;
+
+private:
+	bool has_adaptor(int joltage) const { return (m_adaptors[joltage >> 6] >> (joltage & 63)) & 1; }
+
+	std::vector<uint64_t> m_adaptors;
+	int m_highest_joltage = 0;
+};
 
-// Sort by the adaptor value
-static bool adaptor_cmp(const adaptor_combo& lhs, const adaptor_combo& rhs)
+// Get all the adaptors
+//
+// input:	An adaptor's joltage per line
+adaptor_bag::adaptor_bag(std::ifstream& input)
 {
-	return lhs.first < rhs.first;
+	std::vector<int> joltages;
+	int joltage = 0;
+	while (input >> joltage) {
+		if (joltage > 0) {
+			joltages.push_back(joltage);
+			m_highest_joltage = joltage > m_highest_joltage ? joltage : m_highest_joltage;
+		}
+	}
+
+	// The charging outlet is always at 0
+	m_adaptors.assign(m_highest_joltage / 64 + 1, 0);
+	m_adaptors[0] = 1;
+	for (const int adaptor_joltage : joltages) {
+		m_adaptors[adaptor_joltage >> 6] |= 1ull << (adaptor_joltage & 63);
+	}
+}
+
+// Count the 1 and 3 jolt differences between each adaptor in order, ending with the device 3 above the highest
+//
+// Returns the number of 1 jolt differences multiplied by the number of 3 jolt differences
+long long adaptor_bag::get_jolt_difference_product() const
+{
+	long long one_jolts = 0;
+	long long three_jolts = 1;
+	int prev_joltage = 0;
+	for (size_t word_index = 0; word_index < m_adaptors.size(); ++word_index) {
+		// Skip the outlet, every other set bit is an adaptor in ascending order
+		uint64_t word = word_index == 0 ? m_adaptors[0] & ~1ull : m_adaptors[word_index];
+		while (word != 0) {
+			const int joltage = static_cast<int>(word_index * 64) + count_trailing_zeros_64(word);
+			word &= word - 1;
+
+			switch (joltage - prev_joltage)
+			{
+			case 1:
+				++one_jolts;
+				break;
+			case 3:
+				++three_jolts;
+				break;
+			default:
+				break;
+			}
+			prev_joltage = joltage;
+		}
+	}
+	return one_jolts * three_jolts;
+}
+
+// Count the ways to get from the outlet to the highest adaptor, which is the only way to reach the device
+// The ways to reach a joltage are the sum of the ways to reach the 3 joltages below it, so only those 3 need to be kept
+//
+// Returns the exact number of arrangements in decimal
+std::string adaptor_bag::get_num_arrangements() const
+{
+	big_uint ways[WAYS_RING_MASK + 1];
+	for (big_uint& way : ways) {
+		way.set(0);
+	}
+	ways[0].set(1);
+
+	for (int joltage = 1; joltage <= m_highest_joltage; ++joltage) {
+		big_uint& cur_ways = ways[joltage & WAYS_RING_MASK];
+		if (has_adaptor(joltage)) {
+			cur_ways.set_sum(ways[(joltage - 1) & WAYS_RING_MASK], ways[(joltage - 2) & WAYS_RING_MASK], ways[(joltage - MAX_JOLT_DIFFERENCE) & WAYS_RING_MASK]);
+		} else {
+			cur_ways.set(0);
+		}
+	}
+	return ways[m_highest_joltage & WAYS_RING_MASK].to_string();
 }
 
 /*
@@ -32,49 +206,12 @@ void problem_1::solve(const std::string& file_name)
 		return;
 	}
 
-	std::vector<int> adaptors;
-
-	// Always starts at 0
-	adaptors.emplace_back(0);
-
-	// Get all the adaptors
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		adaptors.emplace_back(std::stoi(input_line));
-	}
-
+	const adaptor_bag adaptors(input);
 	input.close();
 
-	// Sort them into ascending
-	std::sort(adaptors.begin(), adaptors.end());
-
-	// Always ends 3 off
-	adaptors.emplace_back(adaptors.back() + 3);
-
-	// Count the amount of jolt jumps
-	int one_jolts = 0;
-	int three_jolts = 0;
-	auto next_iter = std::next(adaptors.cbegin(), 1);
-	for (auto iter = adaptors.cbegin(); next_iter != adaptors.cend();) {
-		switch ((*next_iter) - (*iter))
-		{
-		case 1:
-			++one_jolts;
-			break;
-		case 3:
-			++three_jolts;
-			break;
-		default:
-			break;
-		}
-		iter = next_iter;
-		++next_iter;
-	}
-
 	std::string answer;
-	answer = std::to_string(one_jolts * three_jolts);
-	output_answer(answer); 
+	answer = std::to_string(adaptors.get_jolt_difference_product());
+	output_answer(answer);
 }
 
 /*
@@ -91,51 +228,8 @@ void problem_2::solve(const std::string& file_name)
 		return;
 	}
 
-	std::vector<adaptor_combo> adaptors;
-
-	// Always starts at 0
-	adaptors.emplace_back(adaptor_combo(0, 0));
-
-	// Get all the adaptors
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		adaptors.emplace_back(adaptor_combo(std::stoi(input_line), 0));
-	}
-
+	const adaptor_bag adaptors(input);
 	input.close();
 
-	// Sort them into ascending
-	std::sort(adaptors.begin(), adaptors.end(), adaptor_cmp);
-
-	// Always ends 3 off and has 1 combination
-	adaptors.emplace_back(adaptor_combo(adaptors.back().first + 3, 1));
-
-	// Last adaptor always has 1 combination
-	adaptors[adaptors.size() - 1].second = 1;
-
-	// Go backwards through the adaptors counting how many combinations can be made
-	for (int i = adaptors.size() - 2; i > 0; --i) {
-		switch (adaptors[i + 2].first - adaptors[i].first)
-		{
-		case 2:
-			// If there's a difference of 2, then we might be able to skip the next 2 adaptors
-			if (adaptors[i + 3].first - adaptors[i].first == 3) {
-				// Add the combinations we can make with the third number
-				adaptors[i].second = adaptors[i + 3].second;
-			}
-		case 1:
-		case 3:
-			// If we can skip the next adaptor, then add together the combinations of having it and not having it
-			adaptors[i].second += adaptors[i + 1].second + adaptors[i + 2].second;
-			break;
-		default:
-			adaptors[i].second = adaptors[i + 1].second;
-			break;
-		}		
-	}
-
-	std::string answer;
-	answer = std::to_string(adaptors.front().second);
-	output_answer(answer);
+	output_answer(adaptors.get_num_arrangements());
 }
\ No newline at end of file
@@ -1,209 +1,689 @@
 #include "day_11.h"
 
 #include "../common_includes.h"
+#include "../bit_utils.h"
 
+#include <cassert>
+#include <cstdint>
 #include <vector>
-#include <map>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DAY_11_HAS_AVX2_KERNEL 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DAY_11_TARGET_AVX2
+#else
+#define DAY_11_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 PROBLEM_CLASS_CPP(11);
 
+// Which seats people care about when deciding to sit or leave
+enum class seating_algorithm {
+	ADJACENT,
+	VISUAL,
+};
+
+// How many occupied seats it takes for someone to leave
+template<seating_algorithm algo>
+struct seating_rule;
+
+template<>
+struct seating_rule<seating_algorithm::ADJACENT> {
+	static constexpr int VACATE_THRESHOLD = 4;
+};
+
+template<>
+struct seating_rule<seating_algorithm::VISUAL> {
+	static constexpr int VACATE_THRESHOLD = 5;
+};
+
 // Contain the room layout and determine how many seats get filled
+// The layout is stored flat with a border of floor around it, so every seat has 8 neighbouring cells in bounds
+// Two occupancy buffers are kept and swapped each frame so nothing is allocated while settling
+// Frames can also be computed incrementally, only re-evaluating the seats whose neighbourhood changed in the last frame
+template<seating_algorithm algo>
 class room {
 public:
-	enum class seating_algorithm {
-		ADJACENT,
-		VISUAL,
-	};
-
-	room(std::ifstream& input, seating_algorithm algo);
+	room(const std::vector<std::string>& lines);
 
 	void next_frame();
-	bool is_settled() const;
+	void next_frame_incremental();
+	bool is_settled() const { return !m_changed_from_last_frame; }
 	int count_occupied_seats() const;
+	bool is_occupied(int row, int col) const { return m_occupied[m_current][get_cell(row, col)] != 0; }
 	void print() const;
 
 private:
-	enum class space {
-		CHAIR_OCC,
-		CHAIR_EMPTY,
-		FLOOR
-	};
-	typedef room::space(room::* algo_sig) (size_t, size_t);
-	typedef std::vector<space> room_layout_row;
-	typedef std::vector<room_layout_row> room_layout;
-
-	space get_next_space(size_t row, size_t col);
-	room::space do_adjacent(size_t row, size_t col);
-	room::space do_visual(size_t row, size_t col);
+	void build_neighbours();
+	void link_line_of_sight(int start_row, int start_col, int row_step, int col_step, std::vector<std::vector<int>>* neighbours) const;
+	int count_occupied_neighbours(const uint8_t* occupied, size_t seat_index) const;
+	void add_to_frontier(int seat_index);
+	void add_neighbours_to_frontier(size_t seat_index);
+
+	int get_cell(int row, int col) const { return (row + 1) * m_width + col + 1; }
+
+	// Width and height including the border
+	int m_width = 0;
+	int m_height = 0;
+
+	// Cell index of every seat, floor is never evaluated
+	std::vector<int> m_seats;
+	std::vector<uint8_t> m_is_seat;
+
+	// 1 if the seat at a cell is occupied, m_occupied[m_current] is the current frame
+	std::vector<uint8_t> m_occupied[2];
+	int m_current = 0;
+
+	// Seat i can see the cells m_neighbours[m_neighbour_offsets[i]..m_neighbour_offsets[i + 1]], only used for the visual algorithm
+	std::vector<int> m_neighbour_offsets;
+	std::vector<int> m_neighbours;
+
+	// Seat index of every cell, -1 for floor
+	std::vector<int> m_cell_seats;
+	// Seats to re-evaluate in the next incremental frame, starting with every seat
+	std::vector<int> m_frontier;
+	std::vector<uint8_t> m_in_frontier;
+	// Seats that change in the frame being computed, applied once every seat in the frontier has been evaluated
+	std::vector<int> m_flips;
 
-	std::map<seating_algorithm, algo_sig> m_algos = { {seating_algorithm::ADJACENT, &room::do_adjacent}, {seating_algorithm::VISUAL, &room::do_visual} };
-
-	seating_algorithm m_algo;
-	room_layout m_layout;
 	bool m_changed_from_last_frame = true;
 };
 
-// Initialize a room with input and a certain algorithm
+// Read the room layout, a line per row
 //
 // input:	Input to read from
-// algo:		Which algorithm to use for the seating
-room::room(std::ifstream& input, seating_algorithm algo) :
-	m_algo(algo)
-{
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		room_layout_row room_line;
-		for (const char cur_space : input_line) {
-			switch (cur_space)
-			{
-			case '.':
-				room_line.emplace_back(space::FLOOR);
-				break;
-			case 'L':
-				room_line.emplace_back(space::CHAIR_EMPTY);
-				break;
-			default:
-				break;
-			}
+//
+// Returns each row of the layout
+static std::vector<std::string> read_layout(std::ifstream& input)
+{
+	std::vector<std::string> lines;
+	std::string input_line;
+	while (std::getline(input, input_line)) {
+		if (!input_line.empty() && input_line.back() == '\r') {
+			input_line.pop_back();
+		}
+		if (!input_line.empty()) {
+			lines.push_back(input_line);
 		}
-		m_layout.push_back(room_line);
 	}
+	return lines;
 }
 
-// Do the adjacent algorithm to determine the value for this location for the next round
+// Get the widest row of the layout
 //
-// row:	Row for this space
-// col:	Column for this space
-room::space room::do_adjacent(size_t row, size_t col)
+// lines:	Each row of the layout
+//
+// Returns the number of columns
+static int get_num_cols(const std::vector<std::string>& lines)
 {
-	// Floors don't change
-	if (m_layout[row][col] == space::FLOOR) {
-		return space::FLOOR;
+	int num_cols = 0;
+	for (const std::string& line : lines) {
+		num_cols = static_cast<int>(line.size()) > num_cols ? static_cast<int>(line.size()) : num_cols;
 	}
+	return num_cols;
+}
 
-	const int max_seats = m_layout[row][col] == space::CHAIR_OCC ? 4 : 1;
-	int seats_occupied = 0;
-	// Check the chairs around us
-	for (size_t cur_row = max(0, row - 1); cur_row < min(row + 2, m_layout.size()); ++cur_row) {
-		for (size_t cur_col = max(0, col - 1); cur_col < min(col + 2, m_layout[row].size()); ++cur_col) {
-			// Don't count the current space
-			if (cur_row == row && cur_col == col) {
-				continue;
-			}
-			if (m_layout[cur_row][cur_col] == space::CHAIR_OCC) {
-				if (++seats_occupied == max_seats) {
-					break;
-				}
+// Initialize a room with a layout
+//
+// lines:	Each row of the layout
+template<seating_algorithm algo>
+room<algo>::room(const std::vector<std::string>& lines)
+{
+	const int num_cols = get_num_cols(lines);
+	m_width = num_cols + 2;
+	m_height = static_cast<int>(lines.size()) + 2;
+	m_is_seat.assign(m_width * m_height, 0);
+	m_occupied[0].assign(m_width * m_height, 0);
+	m_occupied[1].assign(m_width * m_height, 0);
+	m_cell_seats.assign(m_width * m_height, -1);
+
+	for (int row = 0; row < static_cast<int>(lines.size()); ++row) {
+		for (int col = 0; col < static_cast<int>(lines[row].size()); ++col) {
+			const char cur_space = lines[row][col];
+			if (cur_space == 'L' || cur_space == '#') {
+				const int cell = get_cell(row, col);
+				m_is_seat[cell] = 1;
+				m_occupied[m_current][cell] = cur_space == '#';
+				m_cell_seats[cell] = static_cast<int>(m_seats.size());
+				m_seats.push_back(cell);
 			}
 		}
-		if (seats_occupied == max_seats) {
-			break;
+	}
+
+	build_neighbours();
+
+	m_in_frontier.assign(m_seats.size(), 1);
+	m_frontier.resize(m_seats.size());
+	for (size_t seat_index = 0; seat_index < m_seats.size(); ++seat_index) {
+		m_frontier[seat_index] = static_cast<int>(seat_index);
+	}
+}
+
+// The adjacent algorithm reads the 8 surrounding cells directly, so there's nothing to build
+template<>
+void room<seating_algorithm::ADJACENT>::build_neighbours()
+{
+}
+
+// Find the first seat visible in each direction from every seat
+// Seeing is symmetric, so walking each row, column, and diagonal once and linking each pair of consecutive seats finds them all
+template<>
+void room<seating_algorithm::VISUAL>::build_neighbours()
+{
+	const int num_rows = m_height - 2;
+	const int num_cols = m_width - 2;
+	std::vector<std::vector<int>> neighbours(m_width * m_height);
+
+	for (int row = 0; row < num_rows; ++row) {
+		link_line_of_sight(row, 0, 0, 1, &neighbours);
+		link_line_of_sight(row, 0, 1, 1, &neighbours);
+		link_line_of_sight(row, num_cols - 1, 1, -1, &neighbours);
+	}
+	for (int col = 0; col < num_cols; ++col) {
+		link_line_of_sight(0, col, 1, 0, &neighbours);
+		// The diagonals starting in the first column and last column were already walked from the rows
+		if (col > 0) {
+			link_line_of_sight(0, col, 1, 1, &neighbours);
+		}
+		if (col < num_cols - 1) {
+			link_line_of_sight(0, col, 1, -1, &neighbours);
 		}
 	}
-	return seats_occupied == max_seats ? space::CHAIR_EMPTY : space::CHAIR_OCC;
+
+	// Compact into one array
+	m_neighbour_offsets.assign(m_seats.size() + 1, 0);
+	m_neighbours.clear();
+	for (size_t seat_index = 0; seat_index < m_seats.size(); ++seat_index) {
+		const std::vector<int>& seat_neighbours = neighbours[m_seats[seat_index]];
+		m_neighbours.insert(m_neighbours.end(), seat_neighbours.begin(), seat_neighbours.end());
+		m_neighbour_offsets[seat_index + 1] = static_cast<int>(m_neighbours.size());
+	}
 }
 
-// Do the visual algorithm to determine the value for this location for the next round
+// Walk a line through the room, linking each seat with the next seat along it
 //
-// row:	Row for this space
-// col:	Column for this space
-room::space room::do_visual(size_t row, size_t col)
+// start_row:	Row to start from
+// start_col:	Column to start from
+// row_step:	Rows to move each step
+// col_step:	Columns to move each step
+// neighbours:	(Output) The seats each cell can see
+template<seating_algorithm algo>
+void room<algo>::link_line_of_sight(int start_row, int start_col, int row_step, int col_step, std::vector<std::vector<int>>* neighbours) const
 {
-	// Floors don't change
-	if (m_layout[row][col] == space::FLOOR) {
-		return space::FLOOR;
+	int last_seat = -1;
+	for (int row = start_row, col = start_col; row >= 0 && row < m_height - 2 && col >= 0 && col < m_width - 2; row += row_step, col += col_step) {
+		const int cell = get_cell(row, col);
+		if (!m_is_seat[cell]) {
+			continue;
+		}
+		if (last_seat != -1) {
+			(*neighbours)[last_seat].push_back(cell);
+			(*neighbours)[cell].push_back(last_seat);
+		}
+		last_seat = cell;
 	}
+}
 
-	const int max_seats = m_layout[row][col] == space::CHAIR_OCC ? 5 : 1;
+// Count the occupied seats in the 8 surrounding cells, the border means none are out of bounds
+//
+// occupied:	The occupancy of every cell
+// seat_index:	Which seat to count around
+//
+// Returns the number of occupied neighbours
+template<>
+int room<seating_algorithm::ADJACENT>::count_occupied_neighbours(const uint8_t* occupied, size_t seat_index) const
+{
+	const uint8_t* above = occupied + m_seats[seat_index] - m_width;
+	const uint8_t* cur = occupied + m_seats[seat_index];
+	const uint8_t* below = occupied + m_seats[seat_index] + m_width;
+	return above[-1] + above[0] + above[1] + cur[-1] + cur[1] + below[-1] + below[0] + below[1];
+}
+
+// Count the occupied seats among the first seats visible in each direction
+//
+// occupied:	The occupancy of every cell
+// seat_index:	Which seat to count around
+//
+// Returns the number of occupied neighbours
+template<>
+int room<seating_algorithm::VISUAL>::count_occupied_neighbours(const uint8_t* occupied, size_t seat_index) const
+{
 	int seats_occupied = 0;
+	for (int i = m_neighbour_offsets[seat_index]; i < m_neighbour_offsets[seat_index + 1]; ++i) {
+		seats_occupied += occupied[m_neighbours[i]];
+	}
+	return seats_occupied;
+}
 
-	// Go through the different x and y scalings to cover each direction from the start
-	for (int direction_x_scale = -1; direction_x_scale < 2; ++direction_x_scale) {
-		for (int direction_y_scale = -1; direction_y_scale < 2; ++direction_y_scale) {
-			// Skip if there will be no changing
-			if (direction_x_scale == direction_y_scale && direction_x_scale == 0) {
-				continue;
-			}
+// Compute the layout for the next round
+template<seating_algorithm algo>
+void room<algo>::next_frame()
+{
+	const uint8_t* occupied = m_occupied[m_current].data();
+	uint8_t* next_occupied = m_occupied[m_current ^ 1].data();
+
+	bool changed = false;
+	for (size_t seat_index = 0; seat_index < m_seats.size(); ++seat_index) {
+		const int cell = m_seats[seat_index];
+		const int seats_occupied = count_occupied_neighbours(occupied, seat_index);
+		const uint8_t next_space = occupied[cell] ? seats_occupied < seating_rule<algo>::VACATE_THRESHOLD : seats_occupied == 0;
+		next_occupied[cell] = next_space;
+		changed |= next_space != occupied[cell];
+	}
 
-			// Search in the direction for an occupied chair
-			for (int cur_row = row + direction_y_scale, cur_col = col + direction_x_scale; (cur_row < static_cast<int>(m_layout.size()) && cur_row >= 0) && (cur_col < static_cast<int>(m_layout[row].size()) && cur_col >= 0); cur_row += direction_y_scale, cur_col += direction_x_scale) {
-				if (m_layout[cur_row][cur_col] != space::FLOOR) {
-					// If at max seats no need to keep searching
-					if (m_layout[cur_row][cur_col] == space::CHAIR_OCC) {
-						if (++seats_occupied == max_seats) {
-							return seats_occupied == max_seats ? space::CHAIR_EMPTY : space::CHAIR_OCC;
-						}
-					}
-					break;
-				}
-			}
+	m_current ^= 1;
+	m_changed_from_last_frame = changed;
+}
+
+// Compute the layout for the next round, only evaluating the seats in the frontier
+// A seat can only change if it or one of its neighbours changed last frame, so once the room starts to settle
+// the cost of a frame follows the number of seats that changed rather than the size of the room
+// The changes are all found before any are applied, so the single occupancy buffer is updated in place
+template<seating_algorithm algo>
+void room<algo>::next_frame_incremental()
+{
+	uint8_t* occupied = m_occupied[m_current].data();
+
+	m_flips.clear();
+	for (const int seat_index : m_frontier) {
+		m_in_frontier[seat_index] = 0;
+		const int cell = m_seats[seat_index];
+		const int seats_occupied = count_occupied_neighbours(occupied, seat_index);
+		const uint8_t next_space = occupied[cell] ? seats_occupied < seating_rule<algo>::VACATE_THRESHOLD : seats_occupied == 0;
+		if (next_space != occupied[cell]) {
+			m_flips.push_back(seat_index);
 		}
 	}
 
-	return seats_occupied == max_seats ? space::CHAIR_EMPTY : space::CHAIR_OCC;
+	// Seeing is symmetric, so the seats affected by a change are the same seats the changed seat counts
+	m_frontier.clear();
+	for (const int seat_index : m_flips) {
+		occupied[m_seats[seat_index]] ^= 1;
+		add_to_frontier(seat_index);
+		add_neighbours_to_frontier(seat_index);
+	}
+
+	m_changed_from_last_frame = !m_flips.empty();
 }
 
-// Get the next space for this position using the room's algorithm
+// Queue a seat to be evaluated next incremental frame, unless it already is
 //
-// row:	Row for this space
-// col:	Column for this space
-room::space room::get_next_space(size_t row, size_t col)
+// seat_index:	The seat to queue
+template<seating_algorithm algo>
+void room<algo>::add_to_frontier(int seat_index)
 {
-	return (this->*(m_algos[m_algo]))(row, col);
+	if (!m_in_frontier[seat_index]) {
+		m_in_frontier[seat_index] = 1;
+		m_frontier.push_back(seat_index);
+	}
 }
 
-// Compute the layout for the next round
-void room::next_frame()
-{
-	m_changed_from_last_frame = false;
-	// Determine the value for each space for the next round
-	room_layout next_layout;
-	for (size_t row = 0; row < m_layout.size(); ++row) {
-		room_layout_row next_room_line;
-		for (size_t col = 0; col < m_layout[row].size(); ++col) {
-			next_room_line.emplace_back(get_next_space(row, col));
-			if (next_room_line[col] != m_layout[row][col]) {
-				m_changed_from_last_frame = true;
-			}
+// Queue the seats in the 8 surrounding cells
+//
+// seat_index:	The seat that changed
+template<>
+void room<seating_algorithm::ADJACENT>::add_neighbours_to_frontier(size_t seat_index)
+{
+	const int cell = m_seats[seat_index];
+	const int neighbour_cells[] = {
+		cell - m_width - 1, cell - m_width, cell - m_width + 1,
+		cell - 1, cell + 1,
+		cell + m_width - 1, cell + m_width, cell + m_width + 1,
+	};
+	for (const int neighbour_cell : neighbour_cells) {
+		if (m_cell_seats[neighbour_cell] != -1) {
+			add_to_frontier(m_cell_seats[neighbour_cell]);
 		}
-		next_layout.emplace_back(next_room_line);
-
 	}
-	m_layout.swap(next_layout);
 }
 
-// Is the room settled
-bool room::is_settled() const
+// Queue the first seats visible in each direction
+//
+// seat_index:	The seat that changed
+template<>
+void room<seating_algorithm::VISUAL>::add_neighbours_to_frontier(size_t seat_index)
 {
-	return !m_changed_from_last_frame;
+	for (int i = m_neighbour_offsets[seat_index]; i < m_neighbour_offsets[seat_index + 1]; ++i) {
+		add_to_frontier(m_cell_seats[m_neighbours[i]]);
+	}
 }
 
 // Count the number of occupied chairs
 //
 // Returns the number of occupied chairs
-int room::count_occupied_seats() const
+template<seating_algorithm algo>
+int room<algo>::count_occupied_seats() const
 {
-	int empty_seats = 0;
-	for (const room_layout_row& row : m_layout) {
-		for (const space cur_space : row) {
-			if (cur_space == space::CHAIR_OCC) ++empty_seats;
-		}
+	int occupied_seats = 0;
+	for (const int cell : m_seats) {
+		occupied_seats += m_occupied[m_current][cell];
 	}
-	return empty_seats;
+	return occupied_seats;
 }
 
 // Print the room layout
-void room::print() const
+template<seating_algorithm algo>
+void room<algo>::print() const
 {
-	for (const room_layout_row& row : m_layout) {
-		for (const space cur_space : row) {
-			std::cout << (cur_space == space::CHAIR_EMPTY ? 'L' : (cur_space == space::CHAIR_OCC ? '#' : '.'));
+	for (int row = 0; row < m_height - 2; ++row) {
+		for (int col = 0; col < m_width - 2; ++col) {
+			const int cell = get_cell(row, col);
+			std::cout << (!m_is_seat[cell] ? '.' : (m_occupied[m_current][cell] ? '#' : 'L'));
 		}
 		std::cout << '\n';
 	}
 }
 
+// Bit planes of the number of neighbours of each seat, and the seating decision made from them
+// Each input is one bit per seat for whether that neighbour is occupied, so every lane of the word is counted at once
+// The counts are summed with full adders, then the empty seats with no neighbours fill and the occupied seats with 4 or more leave
+//
+// nw - se:		Occupancy of each of the 8 neighbours
+// occupied:	Occupancy of the seats themselves
+// seats:		Which bits are seats
+//
+// Returns the occupancy for the next frame
+static inline uint64_t apply_adjacent_rule(uint64_t nw, uint64_t n, uint64_t ne, uint64_t w, uint64_t e, uint64_t sw, uint64_t s, uint64_t se, uint64_t occupied, uint64_t seats)
+{
+	// Each row of three sums to 2 bits, the middle row only has two
+	const uint64_t above_ones = nw ^ n ^ ne;
+	const uint64_t above_twos = (nw & n) | (ne & (nw ^ n));
+	const uint64_t middle_ones = w ^ e;
+	const uint64_t middle_twos = w & e;
+	const uint64_t below_ones = sw ^ s ^ se;
+	const uint64_t below_twos = (sw & s) | (se & (sw ^ s));
+
+	// Add the rows together
+	const uint64_t count_ones = above_ones ^ middle_ones ^ below_ones;
+	const uint64_t ones_carry = (above_ones & middle_ones) | (below_ones & (above_ones ^ middle_ones));
+	const uint64_t twos_sum = above_twos ^ middle_twos ^ below_twos;
+	const uint64_t twos_carry = (above_twos & middle_twos) | (below_twos & (above_twos ^ middle_twos));
+	const uint64_t count_twos = ones_carry ^ twos_sum;
+	const uint64_t fours_carry = ones_carry & twos_sum;
+	const uint64_t count_fours = twos_carry ^ fours_carry;
+	const uint64_t count_eights = twos_carry & fours_carry;
+
+	const uint64_t no_neighbours = ~(count_ones | count_twos | count_fours | count_eights);
+	const uint64_t at_least_four = count_fours | count_eights;
+	return seats & ((occupied & ~at_least_four) | (~occupied & no_neighbours));
+}
+
+// Signature for a kernel that computes the next frame of a whole bit sliced room
+typedef bool (*adjacent_kernel_sig)(const uint64_t*, const uint64_t*, uint64_t*, int, int, int);
+
+// Compute the next frame 64 seats at a time
+//
+// occupied:		Current occupancy, starting at the first word of the first real row
+// seats:			Which bits are seats, laid out the same as occupied
+// next_occupied:	(Output) Occupancy for the next frame
+// stride:			Words from one row to the next
+// num_rows:		Number of real rows
+// num_words:		Number of real words in each row
+//
+// Returns true if any seat changed
+static bool adjacent_kernel_64(const uint64_t* occupied, const uint64_t* seats, uint64_t* next_occupied, int stride, int num_rows, int num_words)
+{
+	uint64_t changed = 0;
+	for (int row = 0; row < num_rows; ++row) {
+		const uint64_t* above = occupied + (row - 1) * stride;
+		const uint64_t* cur = occupied + row * stride;
+		const uint64_t* below = occupied + (row + 1) * stride;
+		for (int i = 0; i < num_words; ++i) {
+			// Bit c of the shifted words is column c - 1 for west and c + 1 for east, carrying across words
+			const uint64_t next = apply_adjacent_rule(
+				(above[i] << 1) | (above[i - 1] >> 63), above[i], (above[i] >> 1) | (above[i + 1] << 63),
+				(cur[i] << 1) | (cur[i - 1] >> 63), (cur[i] >> 1) | (cur[i + 1] << 63),
+				(below[i] << 1) | (below[i - 1] >> 63), below[i], (below[i] >> 1) | (below[i + 1] << 63),
+				cur[i], seats[row * stride + i]);
+			changed |= next ^ cur[i];
+			next_occupied[row * stride + i] = next;
+		}
+	}
+	return changed != 0;
+}
+
+#ifdef DAY_11_HAS_AVX2_KERNEL
+// Load 4 words of a row shifted so bit c is column c - 1
+//
+// words:	The first word to load
+DAY_11_TARGET_AVX2 static inline __m256i load_west(const uint64_t* words)
+{
+	const __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+	const __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words - 1));
+	return _mm256_or_si256(_mm256_slli_epi64(cur, 1), _mm256_srli_epi64(prev, 63));
+}
+
+// Load 4 words of a row shifted so bit c is column c + 1
+//
+// words:	The first word to load
+DAY_11_TARGET_AVX2 static inline __m256i load_east(const uint64_t* words)
+{
+	const __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+	const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + 1));
+	return _mm256_or_si256(_mm256_srli_epi64(cur, 1), _mm256_slli_epi64(next, 63));
+}
+
+// Load 4 words of a row
+//
+// words:	The first word to load
+DAY_11_TARGET_AVX2 static inline __m256i load_words(const uint64_t* words)
+{
+	return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words));
+}
+
+// The adjacent rule for 256 seats at a time, the same adder tree as apply_adjacent_rule
+//
+// nw - se:		Occupancy of each of the 8 neighbours
+// occupied:	Occupancy of the seats themselves
+// seats:		Which bits are seats
+//
+// Returns the occupancy for the next frame
+DAY_11_TARGET_AVX2 static inline __m256i apply_adjacent_rule_avx2(__m256i nw, __m256i n, __m256i ne, __m256i w, __m256i e, __m256i sw, __m256i s, __m256i se, __m256i occupied, __m256i seats)
+{
+	const __m256i above_ones = _mm256_xor_si256(_mm256_xor_si256(nw, n), ne);
+	const __m256i above_twos = _mm256_or_si256(_mm256_and_si256(nw, n), _mm256_and_si256(ne, _mm256_xor_si256(nw, n)));
+	const __m256i middle_ones = _mm256_xor_si256(w, e);
+	const __m256i middle_twos = _mm256_and_si256(w, e);
+	const __m256i below_ones = _mm256_xor_si256(_mm256_xor_si256(sw, s), se);
+	const __m256i below_twos = _mm256_or_si256(_mm256_and_si256(sw, s), _mm256_and_si256(se, _mm256_xor_si256(sw, s)));
+
+	const __m256i count_ones = _mm256_xor_si256(_mm256_xor_si256(above_ones, middle_ones), below_ones);
+	const __m256i ones_carry = _mm256_or_si256(_mm256_and_si256(above_ones, middle_ones), _mm256_and_si256(below_ones, _mm256_xor_si256(above_ones, middle_ones)));
+	const __m256i twos_sum = _mm256_xor_si256(_mm256_xor_si256(above_twos, middle_twos), below_twos);
+	const __m256i twos_carry = _mm256_or_si256(_mm256_and_si256(above_twos, middle_twos), _mm256_and_si256(below_twos, _mm256_xor_si256(above_twos, middle_twos)));
+	const __m256i count_twos = _mm256_xor_si256(ones_carry, twos_sum);
+	const __m256i fours_carry = _mm256_and_si256(ones_carry, twos_sum);
+	const __m256i count_fours = _mm256_xor_si256(twos_carry, fours_carry);
+	const __m256i count_eights = _mm256_and_si256(twos_carry, fours_carry);
+
+	// andnot(a, b) is ~a & b
+	const __m256i any_neighbours = _mm256_or_si256(_mm256_or_si256(count_ones, count_twos), _mm256_or_si256(count_fours, count_eights));
+	const __m256i at_least_four = _mm256_or_si256(count_fours, count_eights);
+	const __m256i stay = _mm256_andnot_si256(at_least_four, occupied);
+	const __m256i fill = _mm256_andnot_si256(_mm256_or_si256(occupied, any_neighbours), seats);
+	return _mm256_or_si256(_mm256_and_si256(seats, stay), fill);
+}
+
+// Compute the next frame 256 seats at a time, the row words must be padded to a multiple of 4
+//
+// occupied:		Current occupancy, starting at the first word of the first real row
+// seats:			Which bits are seats, laid out the same as occupied
+// next_occupied:	(Output) Occupancy for the next frame
+// stride:			Words from one row to the next
+// num_rows:		Number of real rows
+// num_words:		Number of real words in each row
+//
+// Returns true if any seat changed
+DAY_11_TARGET_AVX2 static bool adjacent_kernel_avx2(const uint64_t* occupied, const uint64_t* seats, uint64_t* next_occupied, int stride, int num_rows, int num_words)
+{
+	__m256i changed = _mm256_setzero_si256();
+	for (int row = 0; row < num_rows; ++row) {
+		const uint64_t* above = occupied + (row - 1) * stride;
+		const uint64_t* cur = occupied + row * stride;
+		const uint64_t* below = occupied + (row + 1) * stride;
+		for (int i = 0; i < num_words; i += 4) {
+			const __m256i cur_words = load_words(cur + i);
+			const __m256i next = apply_adjacent_rule_avx2(
+				load_west(above + i), load_words(above + i), load_east(above + i),
+				load_west(cur + i), load_east(cur + i),
+				load_west(below + i), load_words(below + i), load_east(below + i),
+				cur_words, load_words(seats + row * stride + i));
+			changed = _mm256_or_si256(changed, _mm256_xor_si256(next, cur_words));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(next_occupied + row * stride + i), next);
+		}
+	}
+	return !_mm256_testz_si256(changed, changed);
+}
+
+// Check if the CPU and OS support AVX2
+//
+// Returns true if AVX2 can be used
+static bool cpu_supports_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	// The OS has to save the AVX registers as well
+	__cpuid(info, 1);
+	const bool os_saves_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return os_saves_avx && (info[1] & (1 << 5));
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+// The room for the adjacent algorithm stored as a bit per seat, so the kernels can decide many seats per instruction
+// Every row has a padding word on each side and the room has a padding row above and below, so no neighbour is out of bounds
+class bit_sliced_room {
+public:
+	bit_sliced_room(const std::vector<std::string>& lines);
+
+	void next_frame();
+	bool is_settled() const { return !m_changed_from_last_frame; }
+	int count_occupied_seats() const;
+	bool is_occupied(int row, int col) const;
+
+private:
+	// Words are 4 at a time for AVX2
+	static constexpr int KERNEL_WORDS = 4;
+
+	size_t get_row_start(int row) const { return static_cast<size_t>(row + 1) * m_stride + 1; }
+
+	int m_num_rows = 0;
+	int m_num_words = 0;
+	int m_stride = 0;
+
+	std::vector<uint64_t> m_seats;
+	// m_occupied[m_current] is the current frame
+	std::vector<uint64_t> m_occupied[2];
+	int m_current = 0;
+
+	adjacent_kernel_sig m_kernel = adjacent_kernel_64;
+	bool m_changed_from_last_frame = true;
+};
+
+// Initialize a room with a layout, picking the widest kernel the CPU supports
+//
+// lines:	Each row of the layout
+bit_sliced_room::bit_sliced_room(const std::vector<std::string>& lines)
+{
+	m_num_rows = static_cast<int>(lines.size());
+	m_num_words = (get_num_cols(lines) + 63) / 64;
+	m_num_words = (m_num_words + KERNEL_WORDS - 1) / KERNEL_WORDS * KERNEL_WORDS;
+	m_stride = m_num_words + 2;
+
+	const size_t num_words = static_cast<size_t>(m_num_rows + 2) * m_stride;
+	m_seats.assign(num_words, 0);
+	m_occupied[0].assign(num_words, 0);
+	m_occupied[1].assign(num_words, 0);
+
+	for (int row = 0; row < m_num_rows; ++row) {
+		for (int col = 0; col < static_cast<int>(lines[row].size()); ++col) {
+			const char cur_space = lines[row][col];
+			const uint64_t bit = 1ull << (col & 63);
+			const size_t word_index = get_row_start(row) + col / 64;
+			if (cur_space == 'L' || cur_space == '#') {
+				m_seats[word_index] |= bit;
+			}
+			if (cur_space == '#') {
+				m_occupied[m_current][word_index] |= bit;
+			}
+		}
+	}
+
+#ifdef DAY_11_HAS_AVX2_KERNEL
+	if (cpu_supports_avx2()) {
+		m_kernel = adjacent_kernel_avx2;
+	}
+#endif
+}
+
+// Compute the layout for the next round
+void bit_sliced_room::next_frame()
+{
+	const size_t first_word = get_row_start(0);
+	m_changed_from_last_frame = m_kernel(m_occupied[m_current].data() + first_word, m_seats.data() + first_word, m_occupied[m_current ^ 1].data() + first_word, m_stride, m_num_rows, m_num_words);
+	m_current ^= 1;
+}
+
+// Count the number of occupied chairs
+//
+// Returns the number of occupied chairs
+int bit_sliced_room::count_occupied_seats() const
+{
+	int occupied_seats = 0;
+	for (const uint64_t word : m_occupied[m_current]) {
+		occupied_seats += popcount_64(word);
+	}
+	return occupied_seats;
+}
+
+// Check if a seat is occupied
+//
+// row:	Row for this space
+// col:	Column for this space
+//
+// Returns true if occupied
+bool bit_sliced_room::is_occupied(int row, int col) const
+{
+	return (m_occupied[m_current][get_row_start(row) + col / 64] >> (col & 63)) & 1;
+}
+
+#ifdef _DEBUG
+// Check the bit sliced kernel against the scalar room for every frame until they settle
+//
+// lines:	Each row of the layout
+//
+// Returns true if every frame matched
+static bool verify_bit_sliced_room(const std::vector<std::string>& lines)
+{
+	room<seating_algorithm::ADJACENT> scalar_room(lines);
+	bit_sliced_room sliced_room(lines);
+	const int num_cols = get_num_cols(lines);
+
+	while (!scalar_room.is_settled() || !sliced_room.is_settled()) {
+		scalar_room.next_frame();
+		sliced_room.next_frame();
+		for (int row = 0; row < static_cast<int>(lines.size()); ++row) {
+			for (int col = 0; col < num_cols; ++col) {
+				if (scalar_room.is_occupied(row, col) != sliced_room.is_occupied(row, col)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+#endif
+
 /*
 * The seat layout fits neatly on a grid. Each position is either floor (.), an empty seat (L), or an occupied seat (#)
 * All decisions are based on the number of occupied seats adjacent to a given seat (one of the eight positions immediately up, down, left, right, or diagonal from the seat).
@@ -217,10 +697,20 @@ void room::print() const
 void problem_1::solve(const std::string& file_name)
 {
 	std::ifstream input(file_name);
-	room cur_room(input, room::seating_algorithm::ADJACENT);
+
+	if (!input.is_open()) {
+		return;
+	}
+
+	const std::vector<std::string> lines = read_layout(input);
 	input.close();
 
-	std::string a;
+#ifdef _DEBUG
+	assert(verify_bit_sliced_room(lines));
+#endif
+
+	bit_sliced_room cur_room(lines);
+
 	while (!cur_room.is_settled()) {
 		cur_room.next_frame();
 	}
@@ -239,12 +729,18 @@ void problem_1::solve(const std::string& file_name)
 void problem_2::solve(const std::string& file_name)
 {
 	std::ifstream input(file_name);
-	room cur_room(input, room::seating_algorithm::VISUAL);
+
+	if (!input.is_open()) {
+		return;
+	}
+
+	const std::vector<std::string> lines = read_layout(input);
 	input.close();
 
-	std::string a;
+	room<seating_algorithm::VISUAL> cur_room(lines);
+
 	while (!cur_room.is_settled()) {
-		cur_room.next_frame();
+		cur_room.next_frame_incremental();
 	}
 
 	std::string answer;
@@ -2,200 +2,419 @@
 
 #include "../common_includes.h"
 
-PROBLEM_CLASS_CPP(12);
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <thread>
+#include <vector>
 
-# define M_PI           3.14159265358979323846f
+PROBLEM_CLASS_CPP(12);
 
-typedef std::pair<int, int> coordinate;
+// Fewest instructions worth handing to another thread
+static constexpr size_t MIN_INSTRUCTIONS_PER_THREAD = 1 << 14;
+// How much of the log is read at a time
+static constexpr size_t NAV_LOG_CHUNK_SIZE = 1 << 16;
+
+// Which vector the cardinal actions move
+enum class navigation_model {
+	// The cardinal actions move the ship, the direction vector is the ship's heading
+	SHIP,
+	// The cardinal actions move the waypoint, the direction vector is the waypoint relative to the ship
+	WAYPOINT,
+};
 
-enum class cardinal_direction {
+// What a navigation instruction does, the cardinal directions come first so they can index CARDINAL_UNITS
+enum class nav_opcode : uint32_t {
 	NORTH = 0,
 	EAST,
 	SOUTH,
 	WEST,
-
-	MAX_DIRS,
+	// Turn counter-clockwise by the amount in quarter turns, right turns are decoded as the equivalent left turn
+	TURN,
+	FORWARD,
 };
 
-enum class relative_direction {
-	LEFT,
-	RIGHT,
-	FORWARD
-};
+// An instruction packed into one word, the opcode in the low bits and the amount above it
+typedef uint32_t packed_nav_instruction;
 
-// Base class for an object on the map with a coordinate and direction
-class map_object {
-public:
-	virtual ~map_object() = 0 {};
+static constexpr int NAV_OPCODE_BITS = 3;
+static constexpr uint32_t NAV_OPCODE_MASK = (1 << NAV_OPCODE_BITS) - 1;
+// Largest amount that can be packed, a fused run that would go past it starts a new instruction
+static constexpr uint32_t MAX_NAV_AMOUNT = ~0u >> NAV_OPCODE_BITS;
+// Largest amount a line can have, bigger ones are split over several instructions so this bounds how many one line makes
+static constexpr uint64_t MAX_NAV_LINE_AMOUNT = static_cast<uint64_t>(MAX_NAV_AMOUNT) << 16;
 
-	void move(cardinal_direction dir, unsigned int amount);
-	virtual void rotate(relative_direction dir, int amount);
+static packed_nav_instruction pack_instruction(nav_opcode opcode, uint32_t amount) { return (amount << NAV_OPCODE_BITS) | static_cast<uint32_t>(opcode); }
+static nav_opcode get_opcode(packed_nav_instruction instruction) { return static_cast<nav_opcode>(instruction & NAV_OPCODE_MASK); }
+static uint32_t get_amount(packed_nav_instruction instruction) { return instruction >> NAV_OPCODE_BITS; }
 
-	int distance_from_start();
-	const coordinate& get_coords() const { return m_coordinate; }
+// Integer 2D vector
+struct vec2 {
+	long long m_x;
+	long long m_y;
+};
 
-protected:
-	coordinate m_coordinate = coordinate(0, 0);
-	cardinal_direction m_direction = cardinal_direction::EAST;
+// Integer 2x2 matrix, row major
+struct mat2 {
+	long long m_xx;
+	long long m_xy;
+	long long m_yx;
+	long long m_yy;
 };
 
-// Waypoint that the ship moves toward
-class waypoint : public map_object{
-public:
-	waypoint();
+static constexpr mat2 IDENTITY_MAT2 = { 1, 0, 0, 1 };
+static constexpr mat2 ZERO_MAT2 = { 0, 0, 0, 0 };
 
-	void rotate(relative_direction dir, int amount) override;
+// The vector each cardinal direction moves along
+static constexpr vec2 CARDINAL_UNITS[] = {
+	{ 0, 1 },
+	{ 1, 0 },
+	{ 0, -1 },
+	{ -1, 0 },
 };
 
-// Ship to move on the map
-class ship : public map_object {
-public:
-	void move(relative_direction dir, unsigned int amount);
-	void move(relative_direction dir, unsigned int amount, const waypoint& waypoint_dir);
-};
+static vec2 operator+(const vec2& lhs, const vec2& rhs)
+{
+	return { lhs.m_x + rhs.m_x, lhs.m_y + rhs.m_y };
+}
 
-// Scale operator for coordinate vector
-coordinate operator* (const coordinate& lhs, int rhs)
+static vec2 operator*(const vec2& lhs, long long rhs)
 {
-	coordinate ans;
-	ans.first = lhs.first * rhs;
-	ans.second = lhs.second * rhs;
-	return ans;
+	return { lhs.m_x * rhs, lhs.m_y * rhs };
 }
 
-static cardinal_direction character_to_direction(char dir_char)
+static vec2 operator*(const mat2& lhs, const vec2& rhs)
 {
-	switch (dir_char)
-	{
-	case 'N':
-		return cardinal_direction::NORTH;
-	case 'E':
-		return cardinal_direction::EAST;
-	case 'S':
-		return cardinal_direction::SOUTH;
-	case 'W':
-		return cardinal_direction::WEST;
-	default:
-		return cardinal_direction::MAX_DIRS;
-	}
+	return { lhs.m_xx * rhs.m_x + lhs.m_xy * rhs.m_y, lhs.m_yx * rhs.m_x + lhs.m_yy * rhs.m_y };
 }
 
-static relative_direction character_to_relative_direction(char dir_char)
+static mat2 operator+(const mat2& lhs, const mat2& rhs)
 {
-	switch (dir_char)
-	{
-	case 'R':
-		return relative_direction::RIGHT;
-	case 'L':
-		return relative_direction::LEFT;
-	case 'F':
-		return relative_direction::FORWARD;
-	default:
-		return relative_direction::FORWARD;
-	}
+	return { lhs.m_xx + rhs.m_xx, lhs.m_xy + rhs.m_xy, lhs.m_yx + rhs.m_yx, lhs.m_yy + rhs.m_yy };
+}
+
+static mat2 operator*(const mat2& lhs, const mat2& rhs)
+{
+	return {
+		lhs.m_xx * rhs.m_xx + lhs.m_xy * rhs.m_yx, lhs.m_xx * rhs.m_xy + lhs.m_xy * rhs.m_yy,
+		lhs.m_yx * rhs.m_xx + lhs.m_yy * rhs.m_yx, lhs.m_yx * rhs.m_xy + lhs.m_yy * rhs.m_yy,
+	};
 }
 
-// Get the relative coordinate for the given cardinal direction
+static mat2 operator*(const mat2& lhs, long long rhs)
+{
+	return { lhs.m_xx * rhs, lhs.m_xy * rhs, lhs.m_yx * rhs, lhs.m_yy * rhs };
+}
+
+// Rotate a vector counter-clockwise by swapping and negating, which is exact
 //
-// cardinal_direction: Direction to use
+// vec:				The vector to rotate
+// quarter_turns:	Number of quarter turns, 0 to 3
 //
-// Returns the relative coordinate for the direction
-static coordinate direction_to_coordinate(cardinal_direction dir)
+// Returns the rotated vector
+static vec2 rotate_quarter_turns(const vec2& vec, uint32_t quarter_turns)
 {
-	switch (dir)
+	switch (quarter_turns)
 	{
-	case cardinal_direction::NORTH:
-		return coordinate(0, 1);
-	case cardinal_direction::EAST:
-		return coordinate(1, 0);
-	case cardinal_direction::SOUTH:
-		return coordinate(0, -1);
-	case cardinal_direction::WEST:
-		return coordinate(-1, 0);
+	case 1:
+		return { -vec.m_y, vec.m_x };
+	case 2:
+		return { -vec.m_x, -vec.m_y };
+	case 3:
+		return { vec.m_y, -vec.m_x };
 	default:
-		return coordinate(0, 0);
+		return vec;
 	}
 }
 
-// Rotate the map object 
+// Rotate every column of a matrix counter-clockwise, the same as multiplying by a rotation on the left
+//
+// mat:				The matrix to rotate
+// quarter_turns:	Number of quarter turns, 0 to 3
 //
-// dir:		Direction to turn
-// amount:	Amount of times to turn
-void map_object::rotate(relative_direction dir, int amount)
+// Returns the rotated matrix
+static mat2 rotate_quarter_turns(const mat2& mat, uint32_t quarter_turns)
 {
-	int turns = ((amount / 90) % 4) * (dir == relative_direction::RIGHT ? 1 : -1);
-	turns = (static_cast<int>(m_direction) + turns) % static_cast<int>(cardinal_direction::MAX_DIRS);
-	if (turns < 0) {
-		turns += static_cast<int>(cardinal_direction::MAX_DIRS);
-	}
-	m_direction = static_cast<cardinal_direction>(turns);
+	const vec2 x_col = rotate_quarter_turns(vec2{ mat.m_xx, mat.m_yx }, quarter_turns);
+	const vec2 y_col = rotate_quarter_turns(vec2{ mat.m_xy, mat.m_yy }, quarter_turns);
+	return { x_col.m_x, y_col.m_x, x_col.m_y, y_col.m_y };
+}
+
+// Where the ship is and the vector it moves along
+struct nav_state {
+	vec2 m_ship;
+	vec2 m_direction;
+};
+
+// Affine map of the navigation state, which every instruction and every run of instructions is
+//   direction' = m_turn * direction + m_nudge
+//   ship' = ship + m_travel * direction + m_shift
+// Composing two of these is another of the same form, and composition is associative, so a log can be reduced in any grouping
+struct nav_transform {
+	mat2 m_turn = IDENTITY_MAT2;
+	vec2 m_nudge = { 0, 0 };
+	mat2 m_travel = ZERO_MAT2;
+	vec2 m_shift = { 0, 0 };
+};
+
+// Combine two transforms into one that applies first then second
+//
+// first:	Transform applied first
+// second:	Transform applied after first
+//
+// Returns the combined transform
+static nav_transform compose(const nav_transform& first, const nav_transform& second)
+{
+	nav_transform combined;
+	combined.m_turn = second.m_turn * first.m_turn;
+	combined.m_nudge = second.m_turn * first.m_nudge + second.m_nudge;
+	combined.m_travel = first.m_travel + second.m_travel * first.m_turn;
+	combined.m_shift = first.m_shift + second.m_travel * first.m_nudge + second.m_shift;
+	return combined;
 }
 
-// Move the map object
-// dir:		Direction to move
-// amount:	Amount of spaces to move
-void map_object::move(cardinal_direction dir, unsigned int amount)
+// Apply a transform to a state
+//
+// transform:	The transform to apply
+// state:		State to start from
+//
+// Returns the new state
+static nav_state apply_transform(const nav_transform& transform, const nav_state& state)
 {
-	coordinate new_cord = direction_to_coordinate(dir) * amount;
-	m_coordinate.first += new_cord.first;
-	m_coordinate.second += new_cord.second;
+	nav_state result;
+	result.m_ship = state.m_ship + transform.m_travel * state.m_direction + transform.m_shift;
+	result.m_direction = transform.m_turn * state.m_direction + transform.m_nudge;
+	return result;
 }
 
-// Determine distance from the start
-int map_object::distance_from_start()
+// Follow one more instruction after a transform, the same as composing with the instruction's transform
+// but only touching the parts the instruction changes
+//
+// instruction:	The instruction to follow
+// model:		Which vector the cardinal actions move
+// transform:	(Output) The transform to extend
+static void append_instruction(packed_nav_instruction instruction, navigation_model model, nav_transform* transform)
 {
-	return (abs(m_coordinate.first) + abs(m_coordinate.second));
+	const nav_opcode opcode = get_opcode(instruction);
+	const long long amount = get_amount(instruction);
+	switch (opcode)
+	{
+	case nav_opcode::NORTH:
+	case nav_opcode::EAST:
+	case nav_opcode::SOUTH:
+	case nav_opcode::WEST: {
+		const vec2 move = CARDINAL_UNITS[static_cast<uint32_t>(opcode)] * amount;
+		if (model == navigation_model::SHIP) {
+			transform->m_shift = transform->m_shift + move;
+		} else {
+			transform->m_nudge = transform->m_nudge + move;
+		}
+		break;
+	}
+	case nav_opcode::TURN:
+		transform->m_turn = rotate_quarter_turns(transform->m_turn, static_cast<uint32_t>(amount));
+		transform->m_nudge = rotate_quarter_turns(transform->m_nudge, static_cast<uint32_t>(amount));
+		break;
+	case nav_opcode::FORWARD:
+		transform->m_travel = transform->m_travel + transform->m_turn * amount;
+		transform->m_shift = transform->m_shift + transform->m_nudge * amount;
+		break;
+	default:
+		break;
+	}
 }
 
-// Init the waypoint at 10, 1
-waypoint::waypoint()
+// Compile a run of instructions one after another
+//
+// instructions:	The instructions to compile
+// begin:			First instruction of the run
+// end:				One past the last instruction of the run
+// model:			Which vector the cardinal actions move
+//
+// Returns the transform for the whole run
+static nav_transform compile_range(const std::vector<packed_nav_instruction>& instructions, size_t begin, size_t end, navigation_model model)
 {
-	m_coordinate = coordinate(10, 1);
+	nav_transform transform;
+	for (size_t i = begin; i < end; ++i) {
+		append_instruction(instructions[i], model, &transform);
+	}
+	return transform;
 }
 
-// Rotate the waypoint around the ship in the relative direction
+// Compile the chunks [first_chunk, last_chunk) and reduce them as a tree, handing the upper half of each split to another thread
+// Each thread composes its own chunk in order, then the partial transforms are combined in log(chunks) levels
+//
+// instructions:	The instructions to compile
+// chunk_size:		Instructions per chunk
+// first_chunk:		First chunk to reduce
+// last_chunk:		One past the last chunk to reduce
+// model:			Which vector the cardinal actions move
 //
-// dir:		Relative direction to rotate around
-// amount:	Degrees to rotate by
-void waypoint::rotate(relative_direction dir, int amount)
+// Returns the transform for the chunks
+static nav_transform reduce_chunks(const std::vector<packed_nav_instruction>& instructions, size_t chunk_size, size_t first_chunk, size_t last_chunk, navigation_model model)
 {
-	float angle = (amount / 90) * (.5f * M_PI) * (dir == relative_direction::RIGHT ? -1 : 1);
-	float s = sin(angle);
-	float c = cos(angle);
+	if (last_chunk - first_chunk == 1) {
+		const size_t begin = first_chunk * chunk_size;
+		const size_t end = begin + chunk_size < instructions.size() ? begin + chunk_size : instructions.size();
+		return compile_range(instructions, begin, end, model);
+	}
 
-	// rotate point
-	int x_new = static_cast<int>(round((m_coordinate.first * c) - (m_coordinate.second * s)));
-	int y_new = static_cast<int>(round((m_coordinate.first * s) + (m_coordinate.second * c)));
+	const size_t mid_chunk = first_chunk + (last_chunk - first_chunk) / 2;
+	std::future<nav_transform> upper = std::async(std::launch::async, reduce_chunks, std::cref(instructions), chunk_size, mid_chunk, last_chunk, model);
+	const nav_transform lower = reduce_chunks(instructions, chunk_size, first_chunk, mid_chunk, model);
+	return compose(lower, upper.get());
+}
 
-	m_coordinate.first = x_new;
-	m_coordinate.second = y_new;
+// Compile the whole log into one transform, spreading it over the hardware threads when it's long enough to be worth it
+//
+// instructions:	The instructions to compile
+// model:			Which vector the cardinal actions move
+//
+// Returns the transform for the whole log
+static nav_transform compile_navigation(const std::vector<packed_nav_instruction>& instructions, navigation_model model)
+{
+	size_t num_threads = std::thread::hardware_concurrency();
+	const size_t max_threads = instructions.size() / MIN_INSTRUCTIONS_PER_THREAD;
+	num_threads = num_threads < max_threads ? num_threads : max_threads;
+	if (num_threads <= 1) {
+		return compile_range(instructions, 0, instructions.size(), model);
+	}
+
+	const size_t chunk_size = (instructions.size() + num_threads - 1) / num_threads;
+	const size_t num_chunks = (instructions.size() + chunk_size - 1) / chunk_size;
+	return reduce_chunks(instructions, chunk_size, 0, num_chunks, model);
 }
 
-// Move the ship
+// Decodes the navigation log into packed instructions, fusing runs of the same opcode as it goes
+// Moves in the same direction and forwards add up, and turns add up modulo a full turn
+class nav_decoder {
+public:
+	void decode(std::istream& input);
+
+	std::vector<packed_nav_instruction> m_instructions;
+	// Set if a line's amount was past MAX_NAV_LINE_AMOUNT, the instructions can't be followed
+	bool m_overflowed = false;
+
+private:
+	void finish_line();
+	void add_instruction(nav_opcode opcode, uint64_t amount);
+
+	// The line being decoded, which can carry over from one chunk to the next
+	char m_action = '\0';
+	uint64_t m_amount = 0;
+	bool m_amount_overflowed = false;
+};
+
+// Decode every line of the log, an action then an amount per line
 //
-// dir:		Direction to move the ship. It should be forward
-// amount:	Amount of spaces to move
-void ship::move(relative_direction dir, unsigned int amount)
+// input:	Input to read from
+void nav_decoder::decode(std::istream& input)
+{
+	std::vector<char> buffer(NAV_LOG_CHUNK_SIZE);
+	while (input) {
+		input.read(buffer.data(), buffer.size());
+		const size_t size = static_cast<size_t>(input.gcount());
+		for (size_t pos = 0; pos < size; ++pos) {
+			const char cur_char = buffer[pos];
+			if (cur_char >= '0' && cur_char <= '9') {
+				const uint64_t digit = cur_char - '0';
+				m_amount_overflowed |= m_amount > (MAX_NAV_LINE_AMOUNT - digit) / 10;
+				m_amount = m_amount * 10 + digit;
+			} else if (cur_char == '\n') {
+				finish_line();
+			} else if (cur_char != '\r' && m_action == '\0') {
+				m_action = cur_char;
+			}
+		}
+	}
+	finish_line();
+}
+
+// Turn the line decoded so far into an instruction, skipping anything that isn't one
+void nav_decoder::finish_line()
 {
-	if (dir != relative_direction::FORWARD) {
+	const char action = m_action;
+	const uint64_t amount = m_amount;
+	const bool amount_overflowed = m_amount_overflowed;
+	m_action = '\0';
+	m_amount = 0;
+	m_amount_overflowed = false;
+	if (amount_overflowed) {
+		m_overflowed = true;
 		return;
 	}
-	map_object::move(m_direction, amount);
+
+	switch (action)
+	{
+	case 'N':
+		add_instruction(nav_opcode::NORTH, amount);
+		break;
+	case 'E':
+		add_instruction(nav_opcode::EAST, amount);
+		break;
+	case 'S':
+		add_instruction(nav_opcode::SOUTH, amount);
+		break;
+	case 'W':
+		add_instruction(nav_opcode::WEST, amount);
+		break;
+	case 'L':
+		add_instruction(nav_opcode::TURN, (amount / 90) % 4);
+		break;
+	case 'R':
+		add_instruction(nav_opcode::TURN, (4 - (amount / 90) % 4) % 4);
+		break;
+	case 'F':
+		add_instruction(nav_opcode::FORWARD, amount);
+		break;
+	default:
+		break;
+	}
 }
 
-// Move the ship towards the waypoint
+// Add an instruction, fusing it with the last one when they have the same opcode
+// Moves too far to pack are split over as many instructions as they need
 //
-// dir:				Direction to move the ship. It should be forward
-// amount:			Amount of times to move the ship to the waypoint
-// waypoint_dir:	Direction to waypoint
-void ship::move(relative_direction dir, unsigned int amount, const waypoint& waypoint_dir)
+// opcode:	What the instruction does
+// amount:	How far to move, or how many quarter turns for a turn
+void nav_decoder::add_instruction(nav_opcode opcode, uint64_t amount)
 {
-	if (dir != relative_direction::FORWARD) {
-		return;
+	if (!m_instructions.empty() && get_opcode(m_instructions.back()) == opcode) {
+		const uint32_t last_amount = get_amount(m_instructions.back());
+		if (opcode == nav_opcode::TURN) {
+			m_instructions.back() = pack_instruction(opcode, static_cast<uint32_t>((last_amount + amount) % 4));
+			return;
+		}
+		if (amount <= MAX_NAV_AMOUNT - last_amount) {
+			m_instructions.back() = pack_instruction(opcode, static_cast<uint32_t>(last_amount + amount));
+			return;
+		}
+		// Top up the last instruction so only the rest needs new ones
+		amount -= MAX_NAV_AMOUNT - last_amount;
+		m_instructions.back() = pack_instruction(opcode, MAX_NAV_AMOUNT);
 	}
-	coordinate new_cord = waypoint_dir.get_coords() * amount;
-	m_coordinate.first += new_cord.first;
-	m_coordinate.second += new_cord.second;
+	while (amount > MAX_NAV_AMOUNT) {
+		m_instructions.push_back(pack_instruction(opcode, MAX_NAV_AMOUNT));
+		amount -= MAX_NAV_AMOUNT;
+	}
+	m_instructions.push_back(pack_instruction(opcode, static_cast<uint32_t>(amount)));
+}
+
+// Run the whole log from the start and find how far the ship ended up
+//
+// instructions:		The instructions to follow
+// model:				Which vector the cardinal actions move
+// start_direction:		The vector the ship starts moving along
+//
+// Returns the Manhattan distance of the ship from the start
+static long long navigate(const std::vector<packed_nav_instruction>& instructions, navigation_model model, const vec2& start_direction)
+{
+	nav_state start;
+	start.m_ship = { 0, 0 };
+	start.m_direction = start_direction;
+
+	const nav_state end = apply_transform(compile_navigation(instructions, model), start);
+	return std::llabs(end.m_ship.m_x) + std::llabs(end.m_ship.m_y);
 }
 
 /*
@@ -219,35 +438,17 @@ void problem_1::solve(const std::string& file_name)
 		return;
 	}
 
-	ship cur_ship;
-	map_object* ship_p = &cur_ship;
-
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		std::istringstream input_stream(input_line);
-
-		char dir_char = ' ';
-		unsigned int amount = 0;
-		input_stream >> dir_char >> amount;
+	nav_decoder decoder;
+	decoder.decode(input);
+	input.close();
 
-		// Move or rotate the ship
-		cardinal_direction dir = character_to_direction(dir_char);
-		if (dir != cardinal_direction::MAX_DIRS) {
-			ship_p->move(dir, amount);
-		} else {
-			relative_direction rel_dir = character_to_relative_direction(dir_char);
-			if (rel_dir == relative_direction::FORWARD) {
-				cur_ship.move(rel_dir, amount);
-			} else {
-				cur_ship.rotate(rel_dir, amount);
-			}
-		}
+	if (decoder.m_overflowed) {
+		return;
 	}
-	input.close();
 
+	// The ship starts facing east
 	std::string answer;
-	answer = std::to_string(cur_ship.distance_from_start());
+	answer = std::to_string(navigate(decoder.m_instructions, navigation_model::SHIP, { 1, 0 }));
 	output_answer(answer);
 }
 
@@ -272,37 +473,16 @@ void problem_2::solve(const std::string& file_name)
 		return;
 	}
 
-	ship cur_ship;
-	waypoint cur_waypoint;
-	map_object* ship_p = &cur_ship;
-	map_object* waypoint_p = &cur_waypoint;
-
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		std::istringstream input_stream(input_line);
-
-		char dir_char = ' ';
-		unsigned int amount = 0;
-		input_stream >> dir_char >> amount;
+	nav_decoder decoder;
+	decoder.decode(input);
+	input.close();
 
-		// Move the ship or waypoint or rotate the waypoint
-		cardinal_direction dir = character_to_direction(dir_char);
-		if (dir != cardinal_direction::MAX_DIRS) {
-			waypoint_p->move(dir, amount);
-		} else {
-			relative_direction rel_dir = character_to_relative_direction(dir_char);
-			if (rel_dir == relative_direction::FORWARD) {
-				cur_ship.move(rel_dir, amount, cur_waypoint);
-			} else {
-				waypoint_p->rotate(rel_dir, amount);
-			}
-		}
+	if (decoder.m_overflowed) {
+		return;
 	}
 
-	input.close();
-
+	// The waypoint starts 10 east and 1 north of the ship
 	std::string answer;
-	answer = std::to_string(cur_ship.distance_from_start());
+	answer = std::to_string(navigate(decoder.m_instructions, navigation_model::WAYPOINT, { 10, 1 }));
 	output_answer(answer);
 }
\ No newline at end of file
@@ -2,27 +2,215 @@
 
 #include "../common_includes.h"
 
+#include <cstdint>
 #include <vector>
-#include <set>
-#include <tuple>
 #include <algorithm>
-#include <numeric>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 PROBLEM_CLASS_CPP(13);
 
 typedef std::pair<int, int> bus_id_and_time;
-typedef long long int lli;
 
-std::pair<lli, lli> chinese_remainder_theorem(std::pair<lli, lli> an, std::pair<lli, lli> bn)
+// A timestamp that is m_residue more than a multiple of m_modulus
+struct congruence {
+	uint64_t m_residue;
+	uint64_t m_modulus;
+};
+
+enum class crt_status {
+	SOLVED,
+	// Two of the congruences contradict each other
+	NO_SOLUTION,
+	// The combined modulus doesn't fit in 64 bits
+	TOO_LARGE,
+};
+
+// The combined congruence of a schedule, every solution is m_solution.m_residue plus a multiple of m_solution.m_modulus
+struct crt_result {
+	crt_status m_status;
+	congruence m_solution;
+};
+
+// Multiply two numbers modulo a third without overflowing
+//
+// a:			First number
+// b:			Second number
+// modulus:		Modulus, must not be 0
+//
+// Returns a * b mod modulus
+static uint64_t mul_mod(uint64_t a, uint64_t b, uint64_t modulus)
 {
-	lli n = 0;
-	while ((an.first + (n * an.second)) % bn.second != bn.first) {
-		++n;
+	a %= modulus;
+	b %= modulus;
+#if defined(_MSC_VER) && defined(_M_X64)
+	// Both are below the modulus, so the high half of the product is too and the division can't overflow
+	uint64_t high = 0;
+	const uint64_t low = _umul128(a, b, &high);
+	uint64_t remainder = 0;
+	_udiv128(high, low, modulus, &remainder);
+	return remainder;
+#elif defined(__SIZEOF_INT128__)
+	return static_cast<uint64_t>(static_cast<unsigned __int128>(a) * b % modulus);
+#else
+	// Double and add, never letting either side reach the modulus
+	uint64_t product = 0;
+	while (b != 0) {
+		if (b & 1) {
+			product = product >= modulus - a ? product - (modulus - a) : product + a;
+		}
+		a = a >= modulus - a ? a - (modulus - a) : a + a;
+		b >>= 1;
 	}
+	return product;
+#endif
+}
 
-	lli s = an.first + (n * an.second);
-	return std::make_pair(s, an.second * bn.second);
-};
+// Find the greatest common divisor
+//
+// a:	First number
+// b:	Second number
+//
+// Returns the greatest common divisor of a and b
+static uint64_t greatest_common_divisor(uint64_t a, uint64_t b)
+{
+	while (b != 0) {
+		const uint64_t remainder = a % b;
+		a = b;
+		b = remainder;
+	}
+	return a;
+}
+
+// Find the modular inverse with the extended Euclidean algorithm
+// The Bezout coefficient is kept reduced modulo the modulus so nothing needs to be signed
+//
+// value:		Number to invert, must be coprime with the modulus
+// modulus:		Modulus to invert in
+//
+// Returns x where value * x = 1 mod modulus
+static uint64_t mod_inverse(uint64_t value, uint64_t modulus)
+{
+	if (modulus == 1) {
+		return 0;
+	}
+
+	uint64_t old_remainder = value % modulus;
+	uint64_t remainder = modulus;
+	uint64_t old_coefficient = 1;
+	uint64_t coefficient = 0;
+	while (remainder != 0) {
+		const uint64_t quotient = old_remainder / remainder;
+
+		const uint64_t next_remainder = old_remainder - quotient * remainder;
+		old_remainder = remainder;
+		remainder = next_remainder;
+
+		// old_coefficient - quotient * coefficient, mod the modulus
+		const uint64_t step = mul_mod(quotient, coefficient, modulus);
+		const uint64_t next_coefficient = old_coefficient >= step ? old_coefficient - step : old_coefficient + (modulus - step);
+		old_coefficient = coefficient;
+		coefficient = next_coefficient;
+	}
+	return old_coefficient;
+}
+
+// Combine two congruences into one that holds for exactly the timestamps both hold for
+// The moduli don't have to be coprime, they only have to agree modulo their greatest common divisor
+//
+// lhs:			First congruence, with the residue below the modulus
+// rhs:			Second congruence, with the residue below the modulus
+// combined:	(Output) The combined congruence, can be lhs
+//
+// Returns whether the congruences could be combined
+static crt_status combine_congruences(const congruence& lhs, const congruence& rhs, congruence* combined)
+{
+	const uint64_t divisor = greatest_common_divisor(lhs.m_modulus, rhs.m_modulus);
+	const uint64_t difference = rhs.m_residue >= lhs.m_residue % rhs.m_modulus ? rhs.m_residue - lhs.m_residue % rhs.m_modulus : rhs.m_residue + (rhs.m_modulus - lhs.m_residue % rhs.m_modulus);
+	if (difference % divisor != 0) {
+		return crt_status::NO_SOLUTION;
+	}
+
+	// The combined modulus is the lowest common multiple
+	const uint64_t reduced_modulus = rhs.m_modulus / divisor;
+	if (lhs.m_modulus > ~0ull / reduced_modulus) {
+		return crt_status::TOO_LARGE;
+	}
+
+	// Solve lhs.m_residue + lhs.m_modulus * steps = rhs.m_residue mod rhs.m_modulus for steps
+	const uint64_t steps = mul_mod(difference / divisor, mod_inverse(lhs.m_modulus / divisor, reduced_modulus), reduced_modulus);
+	// steps is below reduced_modulus, so the residue is below the combined modulus
+	const uint64_t residue = lhs.m_residue + lhs.m_modulus * steps;
+	const uint64_t modulus = lhs.m_modulus * reduced_modulus;
+	combined->m_residue = residue;
+	combined->m_modulus = modulus;
+	return crt_status::SOLVED;
+}
+
+// Solve a set of congruences with the chinese remainder theorem, each congruence costs log of the modulus
+//
+// congruences:		The congruences to solve
+//
+// Returns the combined congruence, or why there isn't one
+static crt_result solve_congruences(const std::vector<congruence>& congruences)
+{
+	crt_result result;
+	result.m_status = crt_status::SOLVED;
+	result.m_solution = { 0, 1 };
+	for (const congruence& cur_congruence : congruences) {
+		if (cur_congruence.m_modulus == 0) {
+			continue;
+		}
+		const congruence reduced = { cur_congruence.m_residue % cur_congruence.m_modulus, cur_congruence.m_modulus };
+		result.m_status = combine_congruences(result.m_solution, reduced, &result.m_solution);
+		if (result.m_status != crt_status::SOLVED) {
+			break;
+		}
+	}
+	return result;
+}
+
+// Solve many sets of congruences
+//
+// schedules:	The sets of congruences to solve
+//
+// Returns the result for each set, in the same order
+static std::vector<crt_result> solve_congruence_batch(const std::vector<std::vector<congruence>>& schedules)
+{
+	std::vector<crt_result> results;
+	results.reserve(schedules.size());
+	for (const std::vector<congruence>& schedule : schedules) {
+		results.push_back(solve_congruences(schedule));
+	}
+	return results;
+}
+
+// Get the congruences for a bus schedule, where each listed bus has to leave its position in the list after the timestamp
+//
+// schedule:	Comma seperated bus IDs, x for out of service
+//
+// Returns a congruence per bus in service
+static std::vector<congruence> parse_bus_offsets(const std::string& schedule)
+{
+	std::vector<congruence> congruences;
+	std::istringstream schedule_stream(schedule);
+	std::string bus;
+	uint64_t offset = 0;
+	for (; std::getline(schedule_stream, bus, ','); ++offset) {
+		if (bus.empty() || bus[0] == 'x') {
+			continue;
+		}
+		const uint64_t bus_id = std::stoull(bus);
+		if (bus_id == 0) {
+			continue;
+		}
+		// Leaving offset minutes later means the timestamp is offset short of a multiple of the ID
+		congruences.push_back({ (bus_id - offset % bus_id) % bus_id, bus_id });
+	}
+	return congruences;
+}
 
 /*
 * Each bus has an ID number that also indicates how often the bus leaves for the airport.
@@ -84,35 +272,22 @@ void problem_2::solve(const std::string& file_name)
 		return;
 	}
 
-	std::vector<std::pair<lli, lli>> buses;
-
 	std::string input_line;
 	std::getline(input, input_line); // Unused
 	std::getline(input, input_line);
 	input.close();
 
-	std::istringstream input_line_stream(input_line);
-	std::string bus;
-	int t = -1;
-	// Get bus ids and offset from first id
-	while (!input_line_stream.eof()) {
-		++t;
-		std::getline(input_line_stream, bus, ',');
-		if (bus[0] == 'x') {
-			continue;
-		}
-		int bus_id = std::stoi(bus);
-		buses.emplace_back(std::make_pair(t % bus_id, bus_id));
+	if (!input_line.empty() && input_line.back() == '\r') {
+		input_line.pop_back();
 	}
 
-	std::pair<lli, lli> xn = std::accumulate(std::next(buses.begin(), 1), buses.end(), buses[0], chinese_remainder_theorem);
-	lli n = xn.first;
-	lli mod = xn.second;
-
-	// retrieve the smallest possible integer for the final congruence
-	lli smallest = mod - n % mod;
+	// Every bus lines up again after the lowest common multiple of the IDs, so the residue is the earliest timestamp
+	const std::vector<crt_result> results = solve_congruence_batch({ parse_bus_offsets(input_line) });
+	if (results.front().m_status != crt_status::SOLVED) {
+		return;
+	}
 
 	std::string answer;
-	answer = std::to_string(smallest);
+	answer = std::to_string(results.front().m_solution.m_residue);
 	output_answer(answer);
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "day_14.h"
 
 #include "../common_includes.h"
+#include "../bit_utils.h"
 
-#include <map>
+#include <cstdint>
+#include <vector>
 
 PROBLEM_CLASS_CPP(14);
 
@@ -10,174 +12,429 @@ enum class operations {
 	MASK,
 	MEMORY,
 };
-operations string_to_operation(const std::string& operation_string)
+
+// Addresses and values are 36 bits
+static constexpr uint64_t ADDRESS_MASK = (1ull << 36) - 1;
+static constexpr int MASK_LENGTH = 36;
+// Set in m_first of a decoded instruction when it's a mask
+static constexpr uint64_t MASK_INSTRUCTION_FLAG = 1ull << 63;
+
+// A line of the program packed into two words
+// A mask keeps its 1's in m_first, with MASK_INSTRUCTION_FLAG set, and its X's in m_second
+// A write keeps its address in m_first and its value in m_second
+struct packed_instruction {
+	uint64_t m_first;
+	uint64_t m_second;
+
+	operations get_operation() const { return (m_first & MASK_INSTRUCTION_FLAG) != 0 ? operations::MASK : operations::MEMORY; }
+	uint64_t get_ones() const { return m_first & ~MASK_INSTRUCTION_FLAG; }
+	uint64_t get_floating() const { return m_second; }
+	uint64_t get_address() const { return m_first; }
+	uint64_t get_value() const { return m_second; }
+};
+
+// A set of addresses where the m_care bits are fixed to m_value and every other bit can be anything
+struct address_cube {
+	uint64_t m_value;
+	uint64_t m_care;
+};
+
+// Determine if two cubes share any address
+//
+// lhs:	First cube
+// rhs:	Second cube
+//
+// Returns true if they intersect
+static bool cubes_intersect(const address_cube& lhs, const address_cube& rhs)
 {
-	if (operation_string.compare("mask") == 0) {
-		return operations::MASK;
-	}
-	return operations::MEMORY;
+	return ((lhs.m_value ^ rhs.m_value) & lhs.m_care & rhs.m_care) == 0;
 }
 
-typedef std::map<long long int, long long int> memory_map;
-typedef std::pair<long long int, long long int> masks;   // 1's that get OR'd and 0's that get AND'd
-typedef void(*operation_func) (memory_map*, masks*, std::istringstream*);
+// Count the addresses in a cube, every floating bit doubles them
+//
+// cube:	The cube to count
+//
+// Returns the number of addresses
+static uint64_t count_addresses(const address_cube& cube)
+{
+	return 1ull << popcount_64(~cube.m_care & ADDRESS_MASK);
+}
 
-// Update the mask
+// Count the addresses of a cube that none of the covering cubes reach
+// Covering cubes that fix none of the same bits are independent, so each group is counted on its own and the fractions left multiply
+// Otherwise the space is split in half on the bit the most covering cubes fix, and each half only keeps the cubes that reach it,
+// so a half soon either runs out of covering cubes or is entirely covered by one, long before every address is visited
+//
+// space:		The cube to count addresses of
+// covers:		Cubes inside the space, each one fixing at least the bits the space does
 //
-// memory_p:		(Output) The memory address
-// masks_p:			(Output) The two masks
-// input_stream:	The input
-void mask_func(memory_map* memory_p, masks* masks_p, std::istringstream* input_stream)
+// Returns the number of uncovered addresses
+static uint64_t count_uncovered(const address_cube& space, const std::vector<address_cube>& covers)
 {
-	input_stream->ignore(64, ' ');
-	std::string new_mask;
-	std::getline(*input_stream, new_mask);
-
-	masks_p->first = 0;
-	masks_p->second = 0;
-	int mask_len = new_mask.size() - 1;
-
-	// Get mask from the input
-	for (int i = mask_len; i >= 0; --i) {
-		long long int* mask_p = nullptr;
-		if (new_mask[i] == '1') {
-			mask_p = &(masks_p->first);
-		}
-		else if (new_mask[i] == '0') {
-			mask_p = &(masks_p->second);
+	if (covers.empty()) {
+		return count_addresses(space);
+	}
+	const int floating_bits = popcount_64(~space.m_care & ADDRESS_MASK);
+
+	// Group the covering cubes by the bits they fix, merging any groups that share one
+	std::vector<uint64_t> group_bits;
+	for (const address_cube& cover : covers) {
+		uint64_t split_bits = cover.m_care & ~space.m_care;
+		if (split_bits == 0) {
+			// This one covers all of the space
+			return 0;
 		}
-		else {
-			continue;
+		for (size_t group = 0; group < group_bits.size();) {
+			if ((group_bits[group] & split_bits) != 0) {
+				split_bits |= group_bits[group];
+				group_bits[group] = group_bits.back();
+				group_bits.pop_back();
+			} else {
+				++group;
+			}
 		}
+		group_bits.push_back(split_bits);
+	}
 
-		*mask_p |= (static_cast<long long int>(1) << (mask_len - i));
+	if (group_bits.size() > 1) {
+		// Each group's count only varies over its own bits, the rest of the floating bits are free
+		uint64_t uncovered = 1;
+		int used_bits = 0;
+		std::vector<address_cube> group_covers;
+		for (const uint64_t bits : group_bits) {
+			group_covers.clear();
+			for (const address_cube& cover : covers) {
+				if ((cover.m_care & ~space.m_care & bits) != 0) {
+					group_covers.push_back(cover);
+				}
+			}
+			const int num_bits = popcount_64(bits);
+			used_bits += num_bits;
+			uncovered *= count_uncovered(space, group_covers) >> (floating_bits - num_bits);
+			if (uncovered == 0) {
+				return 0;
+			}
+		}
+		return uncovered << (floating_bits - used_bits);
 	}
 
-	// Not it to be able to and it for the zeros
-	masks_p->second = ~masks_p->second; 
+	// Split on the bit the most covering cubes fix
+	int fixed_counts[64] = {};
+	for (const address_cube& cover : covers) {
+		uint64_t split_bits = cover.m_care & ~space.m_care;
+		while (split_bits != 0) {
+			++fixed_counts[count_trailing_zeros_64(split_bits)];
+			split_bits &= split_bits - 1;
+		}
+	}
+	int split_bit = 0;
+	for (int bit = 1; bit < 64; ++bit) {
+		split_bit = fixed_counts[bit] > fixed_counts[split_bit] ? bit : split_bit;
+	}
+	const uint64_t bit_mask = 1ull << split_bit;
+
+	uint64_t uncovered = 0;
+	std::vector<address_cube> half_covers;
+	for (uint64_t bit_value = 0; bit_value <= bit_mask; bit_value += bit_mask) {
+		address_cube half = space;
+		half.m_care |= bit_mask;
+		half.m_value |= bit_value;
+
+		half_covers.clear();
+		for (const address_cube& cover : covers) {
+			if (cubes_intersect(cover, half)) {
+				half_covers.push_back(cover);
+			}
+		}
+		uncovered += count_uncovered(half, half_covers);
+	}
+	return uncovered;
 }
 
-// Set the memeory
-// 
-// memory_p:		(Output) The memory address
-// masks_p:			(Output) The two masks
-// input_stream:	The input
-void memory_func(memory_map* memory_p, masks* masks_p, std::istringstream* input_stream)
-{
-	// Get the address
-	input_stream->ignore(8, '[');
-	long long int address;
-	*input_stream >> address;
-	if (input_stream->bad() || input_stream->fail()) {
-		return;
-	}
+// Memory written through floating addresses, kept as the cube each write covers rather than every address in it
+class floating_memory {
+public:
+	void write(const address_cube& addresses, uint64_t value);
+	uint64_t sum_values() const;
 
-	input_stream->ignore(4);
-	long long int val;
-	*input_stream >> val;
-	if (input_stream->bad() || input_stream->fail()) {
-		return;
-	}
-	// Set the value at the address after applying the mask
-	(*memory_p)[address] = (val | masks_p->first) & masks_p->second;
+private:
+	struct cube_write {
+		address_cube m_addresses;
+		uint64_t m_value;
+	};
+
+	std::vector<cube_write> m_writes;
+};
+
+// Write a value to every address in a cube
+//
+// addresses:	The addresses to write
+// value:		Value to write
+void floating_memory::write(const address_cube& addresses, uint64_t value)
+{
+	m_writes.push_back({ addresses, value });
 }
 
-// Update the mask
+// Sum the value left at every address
+// Going from the last write back, each write only counts for the addresses no later write covers,
+// found by counting the part of its cube outside every later cube, so the cost depends on the writes rather than the addresses
 //
-// memory_p:		(Output) The memory address
-// masks_p:			(Output) The two masks
-// input_stream:	The input
-void mask_func_2(memory_map* memory_p, masks* masks_p, std::istringstream* input_stream)
+// Returns the sum of all values in memory
+uint64_t floating_memory::sum_values() const
 {
-	input_stream->ignore(64, ' ');
-	std::string new_mask;
-	std::getline(*input_stream, new_mask);
-
-	masks_p->first = 0;
-	masks_p->second = 0;
-	int mask_len = new_mask.size() - 1;
-
-	// Get mask from the input
-	for (int i = mask_len; i >= 0; --i) {
-		long long int* mask_p = nullptr;
-		if (new_mask[i] == '1') {
-			mask_p = &(masks_p->first);
-		}
-		else if (new_mask[i] == 'X') {
-			mask_p = &(masks_p->second);
-		}
-		else {
+	uint64_t total = 0;
+	std::vector<address_cube> covers;
+	for (size_t i = m_writes.size(); i-- > 0;) {
+		const address_cube& space = m_writes[i].m_addresses;
+		if (m_writes[i].m_value == 0) {
 			continue;
 		}
 
-		*mask_p |= (static_cast<long long int>(1) << (mask_len - i));
+		// Only the part of each later cube inside this one matters
+		covers.clear();
+		for (size_t later = i + 1; later < m_writes.size(); ++later) {
+			const address_cube& later_cube = m_writes[later].m_addresses;
+			if (cubes_intersect(space, later_cube)) {
+				covers.push_back({ space.m_value | later_cube.m_value, space.m_care | later_cube.m_care });
+			}
+		}
+
+		total += count_uncovered(space, covers) * m_writes[i].m_value;
+	}
+	return total;
+}
+
+// Set of addresses with open addressing, for remembering which addresses have already been seen
+class address_set {
+public:
+	address_set(size_t expected_addresses = 1024);
+
+	bool insert(uint64_t address);
+
+private:
+	// Addresses are 36 bits, so this is never one
+	static constexpr uint64_t EMPTY_SLOT = ~0ull;
+
+	size_t find_slot(uint64_t address) const;
+	void grow();
+
+	// The size is always a power of 2 and kept at most half full
+	std::vector<uint64_t> m_slots;
+	size_t m_size = 0;
+};
+
+constexpr uint64_t address_set::EMPTY_SLOT;
+
+// Create an empty set
+//
+// expected_addresses:	How many addresses to make room for up front
+address_set::address_set(size_t expected_addresses)
+{
+	size_t num_slots = 16;
+	while (num_slots < expected_addresses * 2) {
+		num_slots *= 2;
 	}
-	// Don't want to not the second mask this time
+	m_slots.assign(num_slots, EMPTY_SLOT);
 }
 
-// Recursively set the memory at the address that fit the floating mask bits
+// Find the slot holding an address, or the empty slot it would go in
+//
+// address:	The address to find
 //
-// memory_p:		(Output) The memory address
-// cur_val:			The current address value to add
-// cur_mask_ind:	The index we are currently at for the floating bit
-// masks_p:			The masks
-// base_addr:		The base address we started from
-// val:				The value to set at the addresses
-void memory_func_2_rec(memory_map* memory_p, long long int cur_val, int cur_mask_ind, masks& masks_p, long long int base_addr, long long int val)
+// Returns the slot index
+size_t address_set::find_slot(uint64_t address) const
 {
-	long long int cur_mask = masks_p.second >> (++cur_mask_ind);
-	if (cur_mask == 0) {
-		if (cur_val == 0) {
-			(*memory_p)[base_addr] = val;
+	const size_t slot_mask = m_slots.size() - 1;
+	// Fibonacci hashing spreads out nearby addresses
+	size_t slot = static_cast<size_t>((address * 0x9E3779B97F4A7C15ull) >> 32) & slot_mask;
+	while (m_slots[slot] != EMPTY_SLOT && m_slots[slot] != address) {
+		slot = (slot + 1) & slot_mask;
+	}
+	return slot;
+}
+
+// Double the table, rehashing every address
+void address_set::grow()
+{
+	std::vector<uint64_t> old_slots(m_slots.size() * 2, EMPTY_SLOT);
+	old_slots.swap(m_slots);
+	for (const uint64_t address : old_slots) {
+		if (address != EMPTY_SLOT) {
+			m_slots[find_slot(address)] = address;
 		}
-		return;
 	}
+}
 
-	while ((cur_mask & 1) == 0) {
-		cur_mask = cur_mask >> 1;
-		++cur_mask_ind;
+// Add an address to the set
+//
+// address:	The address to add
+//
+// Returns true if the address wasn't in the set already
+bool address_set::insert(uint64_t address)
+{
+	const size_t slot = find_slot(address);
+	if (m_slots[slot] == address) {
+		return false;
 	}
-	cur_mask = static_cast<long long int>(1) << cur_mask_ind;
-	(*memory_p)[base_addr + cur_mask + cur_val] = val;
 
-	memory_func_2_rec(memory_p, cur_val, cur_mask_ind, masks_p, base_addr, val);
-	memory_func_2_rec(memory_p, cur_val + cur_mask, cur_mask_ind, masks_p, base_addr, val);
+	m_slots[slot] = address;
+	if (++m_size * 2 > m_slots.size()) {
+		grow();
+	}
+	return true;
 }
 
-// Set the memeory
-// 
-// memory_p:		(Output) The memory address
-// masks_p:			(Output) The two masks
-// input_stream:	The input
-void memory_func_2(memory_map* memory_p, masks* masks_p, std::istringstream* input_stream)
+// Parse a decimal number
+//
+// pos:		(Output) Where to start, left after the last digit
+// end:		End of the text
+//
+// Returns the number
+static uint64_t parse_number(const char** pos, const char* end)
 {
-	// Get teh address
-	input_stream->ignore(8, '[');
-	long long int address;
-	*input_stream >> address;
-	if (input_stream->bad() || input_stream->fail()) {
-		return;
+	uint64_t number = 0;
+	while (*pos < end && **pos >= '0' && **pos <= '9') {
+		number = number * 10 + (**pos - '0');
+		++*pos;
 	}
+	return number;
+}
 
-	input_stream->ignore(4);
-	long long int val;
-	*input_stream >> val;
-	if (input_stream->bad() || input_stream->fail()) {
-		return;
+// Decode the whole program into packed instructions in one pass
+//
+// input:	Input to read from
+//
+// Returns the instructions in order
+static std::vector<packed_instruction> decode_program(std::ifstream& input)
+{
+	std::ostringstream contents_stream;
+	contents_stream << input.rdbuf();
+	const std::string contents = contents_stream.str();
+
+	std::vector<packed_instruction> instructions;
+	const char* pos = contents.data();
+	const char* const end = pos + contents.size();
+	while (pos < end) {
+		const char* line_end = pos;
+		while (line_end < end && *line_end != '\n') {
+			++line_end;
+		}
+
+		if (line_end - pos > 4 && pos[1] == 'a') {
+			// mask = followed by the most significant bit first
+			const char* mask_pos = pos;
+			while (mask_pos < line_end && *mask_pos != '=') {
+				++mask_pos;
+			}
+			mask_pos += 2;
+			if (line_end - mask_pos >= MASK_LENGTH) {
+				packed_instruction mask = { MASK_INSTRUCTION_FLAG, 0 };
+				for (int bit = MASK_LENGTH - 1; bit >= 0; --bit, ++mask_pos) {
+					switch (*mask_pos)
+					{
+					case '1':
+						mask.m_first |= 1ull << bit;
+						break;
+					case 'X':
+						mask.m_second |= 1ull << bit;
+						break;
+					default:
+						break;
+					}
+				}
+				instructions.push_back(mask);
+			}
+		} else if (line_end - pos > 4 && pos[1] == 'e') {
+			// mem[address] = value
+			const char* write_pos = pos + 4;
+			const uint64_t address = parse_number(&write_pos, line_end);
+			while (write_pos < line_end && (*write_pos < '0' || *write_pos > '9')) {
+				++write_pos;
+			}
+			if (write_pos < line_end) {
+				instructions.push_back({ address & ADDRESS_MASK, parse_number(&write_pos, line_end) });
+			}
+		}
+
+		pos = line_end + 1;
 	}
+	return instructions;
+}
 
-	// Update the address from the mask for the start of recurssion
-	address |= masks_p->first;
-	address &= ~masks_p->second;
+// Sum the memory after running the program with the version 1 decoder chip
+// Only the last write to each address matters, so the program is scanned backwards and only the first write seen to each address is kept
+// The writes kept since the last mask seen are waiting for that mask, which is the one before them in the program
+//
+// instructions:	The program to run
+//
+// Returns the sum of all values in memory
+static uint64_t sum_masked_values(const std::vector<packed_instruction>& instructions)
+{
+	address_set seen_addresses;
+	std::vector<uint64_t> pending_values;
+	uint64_t total = 0;
+	for (size_t i = instructions.size(); i-- > 0;) {
+		const packed_instruction& instruction = instructions[i];
+		switch (instruction.get_operation())
+		{
+		case operations::MASK: {
+			// The X's keep the value's bit, everything else is overwritten
+			const uint64_t ones = instruction.get_ones();
+			const uint64_t kept = instruction.get_floating();
+			for (const uint64_t value : pending_values) {
+				total += (value & kept) | ones;
+			}
+			pending_values.clear();
+			break;
+		}
+		case operations::MEMORY:
+			if (seen_addresses.insert(instruction.get_address())) {
+				pending_values.push_back(instruction.get_value());
+			}
+			break;
+		default:
+			break;
+		}
+	}
 
-	// Set all memory address that fit the mask
-	memory_func_2_rec(memory_p, 0, -1, *masks_p, address, val);
+	// Writes before any mask are left as they are
+	for (const uint64_t value : pending_values) {
+		total += value;
+	}
+	return total;
 }
 
-std::map<operations, operation_func> operation_functions = {
-	{operations::MASK, mask_func},
-	{operations::MEMORY, memory_func}
-};
+// Sum the memory after running the program with the version 2 decoder chip
+//
+// instructions:	The program to run
+//
+// Returns the sum of all values in memory
+static uint64_t sum_floating_values(const std::vector<packed_instruction>& instructions)
+{
+	floating_memory memory;
+	uint64_t ones = 0;
+	uint64_t floating = 0;
+	for (const packed_instruction& instruction : instructions) {
+		switch (instruction.get_operation())
+		{
+		case operations::MASK:
+			ones = instruction.get_ones();
+			floating = instruction.get_floating();
+			break;
+		case operations::MEMORY: {
+			// The 1's are set, the X's float and every other bit comes from the address
+			address_cube addresses;
+			addresses.m_care = ~floating & ADDRESS_MASK;
+			addresses.m_value = (instruction.get_address() | ones) & addresses.m_care;
+			memory.write(addresses, instruction.get_value());
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	return memory.sum_values();
+}
 
 /*
 * The initialization program (your puzzle input) can either update the bitmask or write a value to memory.
@@ -191,34 +448,15 @@ void problem_1::solve(const std::string& file_name)
 {
 	std::ifstream input_file(file_name);
 
-	memory_map memory;
-
-	masks cur_masks = std::make_pair(0, ~0);
-	while (!input_file.eof()) {
-		std::string input_line;
-		std::getline(input_file, input_line);
-
-		std::istringstream input_line_stream(input_line);
-		std::string operation_s;
-		std::getline(input_line_stream, operation_s, ' ');
-
-		operations cur_op = string_to_operation(operation_s);
-		if (cur_op == operations::MEMORY) {
-			// Need to read the operation again for the operation
-			input_line_stream.seekg(0, std::ios_base::beg);
-		}
-		operation_functions[cur_op](&memory, &cur_masks, &input_line_stream);
+	if (!input_file.is_open()) {
+		return;
 	}
-	input_file.close();
 
-	// Total up the memories
-	long long int total = 0;
-	for (const auto& memory_addr : memory) {
-		total += memory_addr.second;
-	}
+	const std::vector<packed_instruction> instructions = decode_program(input_file);
+	input_file.close();
 
 	std::string answer;
-	answer = std::to_string(total);
+	answer = std::to_string(sum_masked_values(instructions));
 	output_answer(answer);
 }
 
@@ -234,39 +472,16 @@ void problem_1::solve(const std::string& file_name)
 // What is the sum of all values left in memory after it completes
 void problem_2::solve(const std::string& file_name)
 {
-	// Change the functions to the second version
-	operation_functions[operations::MASK] = mask_func_2;
-	operation_functions[operations::MEMORY] = memory_func_2;
-
 	std::ifstream input_file(file_name);
 
-	memory_map memory;
-
-	masks cur_masks = std::make_pair(0, ~0);
-	while (!input_file.eof()) {
-		std::string input_line;
-		std::getline(input_file, input_line);
-
-		std::istringstream input_line_stream(input_line);
-		std::string operation_s;
-		std::getline(input_line_stream, operation_s, ' ');
-
-		operations cur_op = string_to_operation(operation_s);
-		if (cur_op == operations::MEMORY) {
-			// Need to read the operation again for the operation
-			input_line_stream.seekg(0, std::ios_base::beg);
-		}
-		operation_functions[cur_op](&memory, &cur_masks, &input_line_stream);
+	if (!input_file.is_open()) {
+		return;
 	}
-	input_file.close();
 
-	// Total up the memories
-	long long int total = 0;
-	for (const auto& memory_addr : memory) {
-		total += memory_addr.second;
-	}
+	const std::vector<packed_instruction> instructions = decode_program(input_file);
+	input_file.close();
 
 	std::string answer;
-	answer = std::to_string(total);
+	answer = std::to_string(sum_floating_values(instructions));
 	output_answer(answer);
 }
\ No newline at end of file
@@ -2,98 +2,290 @@
 
 #include "../common_includes.h"
 
-#include <map>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 PROBLEM_CLASS_CPP(15);
 
-/*
-* In this game, the players take turns saying numbers.
-* They begin by taking turns reading from a list of starting numbers (your puzzle input).
-* Then, each turn consists of considering the most recently spoken number:
-*   If that was the first time the number has been spoken, the current player says 0.
-*   Otherwise, the number had been spoken before; the current player announces how many turns apart the number is from when it was previously spoken.
-* So, after the starting numbers, each turn results in that player speaking aloud either 0 (if the last number is new) or an age (if the last number is a repeat)
-*/
+// Numbers below this are spoken all the time, so their part of the table stays in cache and is read directly
+// Anything above is usually spoken once, so a bitmap of which have been spoken is checked before the table
+static constexpr uint32_t DENSE_NUMBERS = 1 << 18;
+// Fewest turns in a batch worth handing to another thread
+static constexpr unsigned long long MIN_TURNS_PER_THREAD = 1 << 16;
 
-// What will be the 2020th number spoken
-void problem_1::solve(const std::string& file_name)
+// The turn each number was last spoken, 0 for never, one entry per number that can be spoken
+// The table is as big as the game is long, so it's backed by huge pages when the OS gives them out to save TLB misses
+class last_seen_table {
+public:
+	last_seen_table() = default;
+	last_seen_table(const last_seen_table&) = delete;
+	last_seen_table& operator=(const last_seen_table&) = delete;
+	~last_seen_table();
+
+	void reset(size_t num_entries);
+
+	uint32_t* m_turns = nullptr;
+	// A bit per number at or above DENSE_NUMBERS, set once it has been spoken
+	std::vector<uint64_t> m_spoken;
+
+private:
+	void release();
+
+	size_t m_capacity = 0;
+	size_t m_allocated_bytes = 0;
+};
+
+// Free the table
+last_seen_table::~last_seen_table()
 {
-	std::ifstream input_file(file_name);
-	// Store each number and what turn it was said
-	std::map<unsigned int, unsigned int> said_numbers;
-	unsigned int turn = 0;
-	unsigned int prev_num = 0;
-	// Get the initialy said numbers
-	while (!input_file.eof()) {
-		std::string input_line;
-		std::getline(input_file, input_line);
-
-		std::istringstream input_line_stream(input_line);
-		std::string number;
-		while (!input_line_stream.eof()) {
-			std::getline(input_line_stream, number, ',');
-			prev_num = std::stoi(number);
-			said_numbers[prev_num] = ++turn;
-		}
+	release();
+}
+
+// Give the table's memory back to the OS
+void last_seen_table::release()
+{
+	if (m_turns == nullptr) {
+		return;
 	}
-	input_file.close();
+#ifdef _WIN32
+	VirtualFree(m_turns, 0, MEM_RELEASE);
+#else
+	munmap(m_turns, m_allocated_bytes);
+#endif
+	m_turns = nullptr;
+	m_capacity = 0;
+	m_allocated_bytes = 0;
+}
 
-	// Get to turn 2020
-	while (turn < 2020) {
-		const auto& prev_num_itr = said_numbers.find(prev_num);
+// Make room for a game and mark every number as never spoken, reusing the memory when it's already big enough
+//
+// num_entries:		Number of different numbers that can be spoken
+void last_seen_table::reset(size_t num_entries)
+{
+	const size_t spoken_words = num_entries > DENSE_NUMBERS ? (num_entries - DENSE_NUMBERS) / 64 + 1 : 0;
+	m_spoken.assign(spoken_words, 0);
 
-		// If the number wasn't found, the new number is 0
-		// Otherwise its the difference of the current turn and when it was last said
-		int new_num = prev_num_itr != said_numbers.end() ? turn - prev_num_itr->second : 0;
+	if (num_entries <= m_capacity) {
+		memset(m_turns, 0, num_entries * sizeof(uint32_t));
+		return;
+	}
 
-		// Update latest turn this word was said
-		said_numbers[prev_num] = turn++;
-		prev_num = new_num;
+	// Fresh pages from the OS are already zeroed
+	release();
+	const size_t bytes = num_entries * sizeof(uint32_t);
+#ifdef _WIN32
+	// Large pages need the lock pages privilege, without it this fails and normal pages are used
+	const SIZE_T large_page_size = GetLargePageMinimum();
+	if (large_page_size != 0) {
+		m_allocated_bytes = (bytes + large_page_size - 1) / large_page_size * large_page_size;
+		m_turns = static_cast<uint32_t*>(VirtualAlloc(nullptr, m_allocated_bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
 	}
+	if (m_turns == nullptr) {
+		m_allocated_bytes = bytes;
+		m_turns = static_cast<uint32_t*>(VirtualAlloc(nullptr, m_allocated_bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+	}
+#else
+	// Explicit huge pages only exist if some were set aside, otherwise ask for transparent ones
+	static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+	m_allocated_bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	void* memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	memory = mmap(nullptr, m_allocated_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (memory == MAP_FAILED) {
+		memory = mmap(nullptr, m_allocated_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+		if (memory != MAP_FAILED) {
+			madvise(memory, m_allocated_bytes, MADV_HUGEPAGE);
+		}
+#endif
+	}
+	m_turns = memory != MAP_FAILED ? static_cast<uint32_t*>(memory) : nullptr;
+#endif
 
-	std::string answer;
-	answer = std::to_string(prev_num);
-	output_answer(answer);
+	if (m_turns == nullptr) {
+		m_allocated_bytes = 0;
+		throw std::bad_alloc();
+	}
+	m_capacity = num_entries;
 }
 
-// What will be the 30000000th number spoken
-void problem_2::solve(const std::string& file_name)
+// Play the memory game
+//
+// starting_numbers:	The numbers said first, must not be empty
+// num_turns:			Which turn to stop at
+// table:				(Output) Storage for the turn each number was last spoken
+//
+// Returns the number spoken on the last turn
+static uint32_t play_memory_game(const std::vector<uint32_t>& starting_numbers, uint32_t num_turns, last_seen_table* table)
 {
-	std::ifstream input_file(file_name);
-	// Store each number and what turn it was said
-	std::map<unsigned int, unsigned int> said_numbers;
-	unsigned int turn = 0;
-	unsigned int prev_num = 0;
-	// Get the initialy said numbers
-	while (!input_file.eof()) {
-		std::string input_line;
-		std::getline(input_file, input_line);
-
-		std::istringstream input_line_stream(input_line);
-		std::string number;
-		while (!input_line_stream.eof()) {
-			std::getline(input_line_stream, number, ',');
-			prev_num = std::stoi(number);
-			said_numbers[prev_num] = ++turn;
+	if (num_turns <= starting_numbers.size()) {
+		return starting_numbers[num_turns - 1];
+	}
+
+	// Every number said after the starting numbers is an age, so it's below the number of turns
+	uint32_t num_entries = num_turns;
+	for (const uint32_t number : starting_numbers) {
+		num_entries = number >= num_entries ? number + 1 : num_entries;
+	}
+	table->reset(num_entries);
+	uint32_t* const last_seen = table->m_turns;
+	uint64_t* const spoken = table->m_spoken.data();
+
+	// The last starting number is only recorded once the next number has been worked out from it
+	uint32_t turn = 0;
+	for (; turn + 1 < starting_numbers.size(); ++turn) {
+		const uint32_t number = starting_numbers[turn];
+		last_seen[number] = turn + 1;
+		if (number >= DENSE_NUMBERS) {
+			spoken[(number - DENSE_NUMBERS) >> 6] |= 1ull << ((number - DENSE_NUMBERS) & 63);
 		}
 	}
+	uint32_t prev_num = starting_numbers.back();
+	++turn;
 
-	// Get to turn 30000000
-	while (turn < 30000000) {
-		const auto& prev_num_itr = said_numbers.find(prev_num);
+	for (; turn < num_turns; ++turn) {
+		uint32_t prev_turn = 0;
+		if (prev_num < DENSE_NUMBERS) {
+			prev_turn = last_seen[prev_num];
+		} else {
+			// Only read the table if the number has been spoken, most high numbers haven't
+			uint64_t& spoken_word = spoken[(prev_num - DENSE_NUMBERS) >> 6];
+			const uint64_t spoken_bit = 1ull << ((prev_num - DENSE_NUMBERS) & 63);
+			if ((spoken_word & spoken_bit) != 0) {
+				prev_turn = last_seen[prev_num];
+			} else {
+				spoken_word |= spoken_bit;
+			}
+		}
+		last_seen[prev_num] = turn;
+		prev_num = prev_turn != 0 ? turn - prev_turn : 0;
+	}
+	return prev_num;
+}
 
-		// If the number wasn't found, the new number is 0
-		// Otherwise its the difference of the current turn and when it was last said
-		int new_num = prev_num_itr != said_numbers.end() ? turn - prev_num_itr->second : 0;
+// Play the games from the next unclaimed seed until every seed has been claimed, with one table for all of them
+//
+// seeds:		Starting numbers for each game
+// num_turns:	Which turn to stop at
+// next_seed:	Index of the next seed to claim, shared by every worker
+// results:		(Output) The number spoken on the last turn of each game, already sized to the seeds
+static void play_claimed_games(const std::vector<std::vector<uint32_t>>& seeds, uint32_t num_turns, std::atomic<size_t>* next_seed, std::vector<uint32_t>* results)
+{
+	last_seen_table table;
+	for (size_t seed = next_seed->fetch_add(1); seed < seeds.size(); seed = next_seed->fetch_add(1)) {
+		(*results)[seed] = seeds[seed].empty() ? 0 : play_memory_game(seeds[seed], num_turns, &table);
+	}
+}
+
+// Play a game for each seed, spreading them over the hardware threads when there are enough turns to be worth it
+// Seeds are claimed one at a time so a thread that finishes early picks up the next, and each thread keeps its table between games
+//
+// seeds:		Starting numbers for each game, an empty seed gives 0
+// num_turns:	Which turn to stop at
+//
+// Returns the number spoken on the last turn of each game, in seed order
+static std::vector<uint32_t> play_memory_games(const std::vector<std::vector<uint32_t>>& seeds, uint32_t num_turns)
+{
+	std::vector<uint32_t> results(seeds.size(), 0);
+	std::atomic<size_t> next_seed(0);
+
+	size_t num_threads = std::thread::hardware_concurrency();
+	const unsigned long long max_threads = seeds.size() * static_cast<unsigned long long>(num_turns) / MIN_TURNS_PER_THREAD;
+	num_threads = num_threads < max_threads ? num_threads : static_cast<size_t>(max_threads);
+	num_threads = num_threads < seeds.size() ? num_threads : seeds.size();
+
+	// This thread is a worker as well, so only the others are launched
+	std::vector<std::future<void>> workers;
+	for (size_t i = 1; i < num_threads; ++i) {
+		workers.push_back(std::async(std::launch::async, play_claimed_games, std::cref(seeds), num_turns, &next_seed, &results));
+	}
+	play_claimed_games(seeds, num_turns, &next_seed, &results);
+	for (std::future<void>& worker : workers) {
+		worker.get();
+	}
+	return results;
+}
 
-		// Update latest turn this word was said
-		said_numbers[prev_num] = turn++;
-		prev_num = new_num;
+// Read the starting numbers for every game
+//
+// input:	Comma seperated numbers, one game per line
+// seeds:	(Output) The numbers of each game in order, skipping blank lines
+static void read_seeds(std::ifstream& input, std::vector<std::vector<uint32_t>>* seeds)
+{
+	std::string input_line;
+	while (std::getline(input, input_line)) {
+		std::vector<uint32_t> starting_numbers;
+		const char* pos = input_line.c_str();
+		while (*pos != '\0') {
+			if (*pos >= '0' && *pos <= '9') {
+				char* number_end = nullptr;
+				starting_numbers.push_back(static_cast<uint32_t>(std::strtoul(pos, &number_end, 10)));
+				pos = number_end;
+			} else {
+				++pos;
+			}
+		}
+		if (!starting_numbers.empty()) {
+			seeds->push_back(std::move(starting_numbers));
+		}
+	}
+}
+
+// Play every game in the file
+//
+// file_name:	The file to read
+// num_turns:	Which turn to stop at
+//
+// Returns the number spoken on the last turn of each game, comma seperated, or empty if there were none
+static std::string play_file(const std::string& file_name, uint32_t num_turns)
+{
+	std::ifstream input_file(file_name);
+
+	if (!input_file.is_open()) {
+		return std::string();
 	}
 
+	std::vector<std::vector<uint32_t>> seeds;
+	read_seeds(input_file, &seeds);
 	input_file.close();
 
 	std::string answer;
-	answer = std::to_string(prev_num);
-	output_answer(answer);
+	for (const uint32_t result : play_memory_games(seeds, num_turns)) {
+		answer += answer.empty() ? "" : ",";
+		answer += std::to_string(result);
+	}
+	return answer;
+}
+
+/*
+* In this game, the players take turns saying numbers.
+* They begin by taking turns reading from a list of starting numbers (your puzzle input).
+* Then, each turn consists of considering the most recently spoken number:
+*   If that was the first time the number has been spoken, the current player says 0.
+*   Otherwise, the number had been spoken before; the current player announces how many turns apart the number is from when it was previously spoken.
+* So, after the starting numbers, each turn results in that player speaking aloud either 0 (if the last number is new) or an age (if the last number is a repeat)
+*/
+
+// What will be the 2020th number spoken
+void problem_1::solve(const std::string& file_name)
+{
+	output_answer(play_file(file_name, 2020));
+}
+
+// What will be the 30000000th number spoken
+void problem_2::solve(const std::string& file_name)
+{
+	output_answer(play_file(file_name, 30000000));
 }
\ No newline at end of file
@@ -1,105 +1,311 @@
 #include "day_16.h"
 
 #include "../common_includes.h"
+#include "../bit_utils.h"
 
-#include <algorithm>
-#include <map>
-#include <set>
+#include <cstdint>
 #include <vector>
 
 PROBLEM_CLASS_CPP(16);
 
-typedef int field;
-typedef std::pair<int, int> range;
-typedef std::vector<range> full_range;
-typedef std::map<std::string, field> field_ind;
-typedef std::map<field, full_range> field_range;
-bool number_is_valid(int val, const field_range& field_ranges);
+// Fields are tracked as bits in a 64 bit mask
+static constexpr size_t MAX_FIELDS = 64;
+
+// The field rules compiled into lookups over every value they cover, so checking a value is a single load
+class ticket_rules {
+public:
+	ticket_rules(std::ifstream& input);
+
+	bool is_valid(int val) const { return val >= 0 && static_cast<size_t>(val) < m_num_values && ((m_valid_values[val >> 6] >> (val & 63)) & 1) != 0; }
+	uint64_t get_field_mask(int val) const { return val >= 0 && static_cast<size_t>(val) < m_num_values ? m_field_masks[val] : 0; }
+	uint64_t get_all_fields_mask() const;
+
+	std::vector<std::string> m_field_names;
+
+private:
+	void add_range(size_t field_num, int min, int max);
+
+	size_t m_num_values = 0;
+	// A bit per value, set if it's in any field's ranges
+	std::vector<uint64_t> m_valid_values;
+	// Per value, a bit for each of the first MAX_FIELDS fields whose ranges it's in
+	std::vector<uint64_t> m_field_masks;
+};
+
+// Read the rules for each field, one per line up to a blank line
+//
+// input:	Input to read from, each line a field name followed by its ranges
+ticket_rules::ticket_rules(std::ifstream& input)
+{
+	std::string input_line;
+	while (std::getline(input, input_line) && !input_line.empty()) {
+		std::istringstream input_line_stream(input_line);
+
+		std::string field_s;
+		std::getline(input_line_stream, field_s, ':');
+		const size_t field_num = m_field_names.size();
+		m_field_names.push_back(field_s);
+
+		// Ranges are "min-max" seperated by " or "
+		int min, max;
+		while (input_line_stream >> min) {
+			input_line_stream.ignore();
+			if (!(input_line_stream >> max)) {
+				break;
+			}
+			input_line_stream.ignore(4);
+			add_range(field_num, min, max);
+		}
+	}
+}
+
+// Add a range of values to a field, growing the lookups to cover it
+//
+// field_num:	The field the range belongs to
+// min:			Lowest value in the range
+// max:			Highest value in the range
+void ticket_rules::add_range(size_t field_num, int min, int max)
+{
+	min = min > 0 ? min : 0;
+	if (max < min) {
+		return;
+	}
+
+	if (static_cast<size_t>(max) >= m_num_values) {
+		m_num_values = static_cast<size_t>(max) + 1;
+		m_valid_values.resize(m_num_values / 64 + 1, 0);
+		m_field_masks.resize(m_num_values, 0);
+	}
+
+	const uint64_t field_bit = field_num < MAX_FIELDS ? 1ull << field_num : 0;
+	for (int val = min; val <= max; ++val) {
+		m_valid_values[val >> 6] |= 1ull << (val & 63);
+		m_field_masks[val] |= field_bit;
+	}
+}
+
+// Get a mask with a bit for every field
+//
+// Returns the mask
+uint64_t ticket_rules::get_all_fields_mask() const
+{
+	return m_field_names.size() >= MAX_FIELDS ? ~0ull : (1ull << m_field_names.size()) - 1;
+}
 
 // Ticket to hold the different fields
 class ticket
 {
 public:
-	bool init(const field_range& field_ranges, const std::string& input);
+	bool init(const ticket_rules& rules, const std::string& input);
 	std::vector<int> field_values;
 };
 
 // Initialize a ticket with valid ranges and input
 //
-// field_ranges:	Valid field ranges
-// input:			Input to read from
+// rules:	Valid field rules
+// input:	Input to read from
 //
 // Returns true if a valid ticket was created
-bool ticket::init(const field_range& field_ranges, const std::string& input)
+bool ticket::init(const ticket_rules& rules, const std::string& input)
 {
 	std::istringstream input_line_stream(input);
 	int num;
-	while (!input_line_stream.eof()) {
-		input_line_stream >> num;
+	while (input_line_stream >> num) {
 		input_line_stream.ignore();
-		if (!number_is_valid(num, field_ranges)) {
+		if (!rules.is_valid(num)) {
 			return false;
 		}
 		field_values.push_back(num);
 	}
-	return true;
+	return !field_values.empty();
+}
+
+// Skip past the next line
+//
+// input:	Input to skip in
+static void skip_line(std::ifstream& input)
+{
+	std::string input_line;
+	std::getline(input, input_line);
+}
+
+// Get the fields each value on a ticket could be, without any allocation once the output has grown
+//
+// rules:		Valid field rules, with at most MAX_FIELDS fields
+// input:		Comma seperated values
+// value_masks:	(Output) The fields each value could be, in column order
+//
+// Returns true if every value is valid for some field
+static bool get_value_masks(const ticket_rules& rules, const std::string& input, std::vector<uint64_t>* value_masks)
+{
+	value_masks->clear();
+	const char* pos = input.c_str();
+	while (*pos != '\0') {
+		if (*pos < '0' || *pos > '9') {
+			++pos;
+			continue;
+		}
+		int val = 0;
+		for (; *pos >= '0' && *pos <= '9'; ++pos) {
+			val = val * 10 + (*pos - '0');
+		}
+		// With every field in the masks, a value is only invalid if it's in none of them
+		const uint64_t mask = rules.get_field_mask(val);
+		if (mask == 0) {
+			return false;
+		}
+		value_masks->push_back(mask);
+	}
+	return !value_masks->empty();
 }
 
-// Determine if a value is valid within any of the ranges
+// Matches every column to a different field, given the fields each column could be
+// Columns with only one possible field are settled first, each one removing its field from the rest
+// If that leaves columns unsettled, Hopcroft-Karp finds a matching for them, which is one of several if the notes are ambiguous
+class field_assigner {
+public:
+	bool assign(const std::vector<uint64_t>& possible_fields);
+
+	// The field matched to each column
+	std::vector<int> m_column_fields;
+
+private:
+	bool propagate_singletons();
+	bool find_layers();
+	bool find_augmenting_path(int column);
+
+	std::vector<uint64_t> m_possible_fields;
+	// The column matched to each field, -1 if none
+	int m_field_columns[MAX_FIELDS];
+	// Breadth first distance of each column from an unmatched column, for Hopcroft-Karp
+	std::vector<int> m_layers;
+};
+
+// Match every column to a field
 //
-// val:				Number to check
-// field_ranges:	Valid ranges to check against
+// possible_fields:	The fields each column could be as a mask, at most MAX_FIELDS columns
 //
-// Returns true if its valid
-bool number_is_valid(int val, const field_range& field_ranges)
+// Returns true if every column has a different field
+bool field_assigner::assign(const std::vector<uint64_t>& possible_fields)
 {
-	for (const auto& field_range_iter : field_ranges) {
-		for (const auto& range_iter : field_range_iter.second) {
-			if (val >= range_iter.first && val <= range_iter.second) {
-				return true;
+	m_possible_fields = possible_fields;
+	m_column_fields.assign(possible_fields.size(), -1);
+	for (int& field_column : m_field_columns) {
+		field_column = -1;
+	}
+	if (possible_fields.size() > MAX_FIELDS || !propagate_singletons()) {
+		return false;
+	}
+
+	size_t num_matched = 0;
+	for (const int field : m_column_fields) {
+		num_matched += field >= 0 ? 1 : 0;
+	}
+
+	// Settled columns only have their own field left, so they stay matched to it while the rest are searched
+	m_layers.resize(m_possible_fields.size());
+	while (num_matched < m_possible_fields.size() && find_layers()) {
+		for (size_t column = 0; column < m_possible_fields.size(); ++column) {
+			if (m_column_fields[column] < 0 && find_augmenting_path(static_cast<int>(column))) {
+				++num_matched;
 			}
 		}
 	}
-	return false;
+	return num_matched == m_possible_fields.size();
 }
 
-// Get the valid fields that the given value could be within
+// Settle every column that has one possible field, and any that are left with one after removing settled fields
 //
-// valid_fields:	(Output) The fields that are valid for the value
-// val:				The value to check with
-// field_ranges:	The ranges to check against
-void get_valid_fields(std::set<field>* valid_fields, int val, const field_range& field_ranges)
+// Returns false if a column is left with no possible fields
+bool field_assigner::propagate_singletons()
 {
-	for (const auto& field_range_iter : field_ranges) {
-		for (const auto& range_iter : field_range_iter.second) {
-			if (val >= range_iter.first && val <= range_iter.second) {
-				valid_fields->emplace(field_range_iter.first);
-				break;
+	std::vector<size_t> singletons;
+	for (size_t column = 0; column < m_possible_fields.size(); ++column) {
+		if (m_possible_fields[column] == 0) {
+			return false;
+		}
+		if (popcount_64(m_possible_fields[column]) == 1) {
+			singletons.push_back(column);
+		}
+	}
+
+	for (size_t next = 0; next < singletons.size(); ++next) {
+		const size_t column = singletons[next];
+		const uint64_t field_bit = m_possible_fields[column];
+		const int field = count_trailing_zeros_64(field_bit);
+		// Two columns were left with the same single field
+		if (m_field_columns[field] >= 0) {
+			return false;
+		}
+		m_column_fields[column] = field;
+		m_field_columns[field] = static_cast<int>(column);
+
+		for (size_t i = 0; i < m_possible_fields.size(); ++i) {
+			if (i == column || (m_possible_fields[i] & field_bit) == 0) {
+				continue;
+			}
+			m_possible_fields[i] &= ~field_bit;
+			if (m_possible_fields[i] == 0) {
+				return false;
+			}
+			if (popcount_64(m_possible_fields[i]) == 1) {
+				singletons.push_back(i);
 			}
 		}
 	}
+	return true;
 }
 
-// Remove any fields that are already known from other valid fields' possibilities
+// Layer the columns by how many matched edges they are from an unmatched column
 //
-// valid_fields:	Everyone's valid fields 
-// field_index:	
-void remove_used_field(std::vector<std::set<field>>& valid_fields, size_t field_index)
+// Returns true if an unmatched field can be reached, so there's an augmenting path
+bool field_assigner::find_layers()
 {
-	const field& cur_field = *(valid_fields[field_index].begin());
-	for (size_t i = 0; i < valid_fields.size(); ++i) {
-		if (i == field_index) {
-			continue;
+	static constexpr int UNREACHED = -1;
+
+	std::vector<int> queue;
+	for (size_t column = 0; column < m_possible_fields.size(); ++column) {
+		m_layers[column] = m_column_fields[column] < 0 ? 0 : UNREACHED;
+		if (m_column_fields[column] < 0) {
+			queue.push_back(static_cast<int>(column));
 		}
-		auto found_iter = valid_fields[i].find(cur_field);
-		if (found_iter != valid_fields[i].end()) {
-			valid_fields[i].erase(found_iter);
-			// If this is now known which field and we already passed this index, call the function again
-			if (i < field_index && valid_fields[i].size() == 1) {
-				remove_used_field(valid_fields, i);
+	}
+
+	bool found_free_field = false;
+	for (size_t next = 0; next < queue.size(); ++next) {
+		const int column = queue[next];
+		for (uint64_t fields = m_possible_fields[column]; fields != 0; fields &= fields - 1) {
+			const int matched_column = m_field_columns[count_trailing_zeros_64(fields)];
+			if (matched_column < 0) {
+				found_free_field = true;
+			} else if (m_layers[matched_column] == UNREACHED) {
+				m_layers[matched_column] = m_layers[column] + 1;
+				queue.push_back(matched_column);
 			}
 		}
 	}
+	return found_free_field;
+}
+
+// Search down the layers for a path ending at an unmatched field, flipping the matches along it
+//
+// column:	Column to start from
+//
+// Returns true if the path was found and the column is now matched
+bool field_assigner::find_augmenting_path(int column)
+{
+	for (uint64_t fields = m_possible_fields[column]; fields != 0; fields &= fields - 1) {
+		const int field = count_trailing_zeros_64(fields);
+		const int matched_column = m_field_columns[field];
+		if (matched_column < 0 || (m_layers[matched_column] == m_layers[column] + 1 && find_augmenting_path(matched_column))) {
+			m_column_fields[column] = field;
+			m_field_columns[field] = column;
+			return true;
+		}
+	}
+	// Nothing more can be found through this column this round
+	m_layers[column] = -1;
+	return false;
 }
 
 /*
@@ -114,52 +320,29 @@ void remove_used_field(std::vector<std::set<field>>& valid_fields, size_t field_
 // Consider the validity of the nearby tickets you scanned. What is your ticket scanning error rate
 void problem_1::solve(const std::string& file_name)
 {
-	int ticket_error = 0;
-	field_range field_ranges;
 	std::ifstream input_file(file_name);
 
-	std::string input_line;
-	std::getline(input_file, input_line);
-
-	// Extract the fields and their ranges
-	field field_num = 0;
-	while (!input_line.empty()) {
-		std::istringstream input_line_stream(input_line);
-
-		std::string field_s;
-		std::getline(input_line_stream, field_s, ':');
-
-		full_range cur_range;
-		int min, max;
-		while (!input_line_stream.eof()) {
-			input_line_stream >> min;
-			input_line_stream.ignore();
-			input_line_stream >> max;
-			input_line_stream.ignore(4);
-
-			cur_range.emplace_back(std::make_pair(min, max));
-		}
-		field_ranges.emplace(field_num++, cur_range);
-		std::getline(input_file, input_line);
+	if (!input_file.is_open()) {
+		return;
 	}
 
-	input_file.ignore(600, '\n');
+	const ticket_rules rules(input_file);
 
 	// My ticket
-	input_file.ignore(600, '\n');
-
-	input_file.ignore(600, '\n');
-	input_file.ignore(600, '\n');
+	skip_line(input_file);
+	skip_line(input_file);
+	skip_line(input_file);
+	skip_line(input_file);
 
 	// Nearby tickets
-	while (!input_file.eof()) {
-		std::getline(input_file, input_line);
+	int ticket_error = 0;
+	std::string input_line;
+	while (std::getline(input_file, input_line)) {
 		std::istringstream input_line_stream(input_line);
 		int num;
-		while (!input_line_stream.eof()) {
-			input_line_stream >> num;
+		while (input_line_stream >> num) {
 			input_line_stream.ignore();
-			if (!number_is_valid(num, field_ranges)) {
+			if (!rules.is_valid(num)) {
 				ticket_error += num;
 			}
 		}
@@ -181,107 +364,51 @@ void problem_1::solve(const std::string& file_name)
 // What do you get if you multiply the six fields that start with the word 'departure' values together
 void problem_2::solve(const std::string& file_name)
 {
-	field_range field_ranges;
-	field_ind field_indecies;
 	std::ifstream input_file(file_name);
 
-	std::string input_line;
-	std::getline(input_file, input_line);
-
-	// Extract the fields and their ranges
-	field field_num = 0;
-	while (!input_line.empty()) {
-		std::istringstream input_line_stream(input_line);
-
-		std::string field_s;
-		std::getline(input_line_stream, field_s, ':');
-		field_indecies.emplace(field_s, field_num);
-
-		full_range cur_range;
-		int min, max;
-		while (!input_line_stream.eof()) {
-			input_line_stream >> min;
-			input_line_stream.ignore();
-			input_line_stream >> max;
-			input_line_stream.ignore(4);
+	if (!input_file.is_open()) {
+		return;
+	}
 
-			cur_range.emplace_back(std::make_pair(min, max));
-		}
-		field_ranges.emplace(field_num++, cur_range);
-		std::getline(input_file, input_line);
+	const ticket_rules rules(input_file);
+	if (rules.m_field_names.size() > MAX_FIELDS) {
+		return;
 	}
 
-	input_file.ignore(600, '\n');
+	skip_line(input_file);
 
 	// My ticket
+	std::string input_line;
 	std::getline(input_file, input_line);
 	ticket my_ticket;
-	my_ticket.init(field_ranges, input_line);
+	my_ticket.init(rules, input_line);
 
-	input_file.ignore(600, '\n');
-	input_file.ignore(600, '\n');
+	skip_line(input_file);
+	skip_line(input_file);
 
-	// Nearby tickets
-	std::vector<ticket> nearby_tickets;
-	while (!input_file.eof()) {
-		std::getline(input_file, input_line);
-		ticket cur_ticket;
-		if (cur_ticket.init(field_ranges, input_line)) {
-			nearby_tickets.push_back(cur_ticket);
-		}
-	}
-	input_file.close();
-
-	// Figure out order
-	std::vector<std::set<field>> possible_fields;
-	for (const auto& nearby_ticket : nearby_tickets) {
-		// Go through each value 
-		for (size_t i = 0; i < nearby_ticket.field_values.size(); ++i) {
-			// Get the possible fields for this value
-			std::set<field> valid_fields;
-			get_valid_fields(&valid_fields, nearby_ticket.field_values[i], field_ranges);
-			// If there aren't any possibilities yet, just add these
-			if (i >= possible_fields.size()) {
-				possible_fields.push_back(valid_fields);
-			} else {
-				// Intersect the valid fields for this value and the current possible fields
-				std::set<field> intersection;
-				auto it = std::set_intersection(valid_fields.cbegin(), valid_fields.cend(), possible_fields[i].cbegin(), possible_fields[i].cend(), std::inserter(intersection, intersection.begin()));
-				possible_fields[i].swap(intersection);
-			}
+	// Each column can only be the fields that every valid nearby ticket's value in it allows
+	std::vector<uint64_t> possible_fields(my_ticket.field_values.size(), rules.get_all_fields_mask());
+	std::vector<uint64_t> value_masks;
+	while (std::getline(input_file, input_line)) {
+		if (!get_value_masks(rules, input_line, &value_masks) || value_masks.size() != possible_fields.size()) {
+			continue;
 		}
-
-		// Remove known fields from possible fields
 		for (size_t i = 0; i < possible_fields.size(); ++i) {
-			if (possible_fields[i].size() == 1) {
-				remove_used_field(possible_fields, i);
-			}
+			possible_fields[i] &= value_masks[i];
 		}
+	}
+	input_file.close();
 
-		// If there's only one possible field per value, then the fields are figured out
-		bool figured_out = true;
-		for (const auto& cur_possible_fields : possible_fields) {
-			if (cur_possible_fields.size() != 1) {
-				figured_out = false;
-				break;
-			}
-		}
-		if (figured_out) {
-			break;
-		}
+	field_assigner assigner;
+	if (!assigner.assign(possible_fields)) {
+		return;
 	}
 
 	long long int ans = 1;
-	for (const auto& field_index_pair : field_indecies) {
+	for (size_t real_index = 0; real_index < assigner.m_column_fields.size(); ++real_index) {
 		// For each departure field
-		if (field_index_pair.first.find("departure") != std::string::npos) {
-			// Find the position for that field num
-			for (size_t real_index = 0; real_index < possible_fields.size(); ++real_index) {
-				if (*possible_fields[real_index].begin() == field_index_pair.second) {
-					ans *= my_ticket.field_values[real_index];
-					break;
-				}
-			}
+		if (rules.m_field_names[assigner.m_column_fields[real_index]].find("departure") != std::string::npos) {
+			ans *= my_ticket.field_values[real_index];
 		}
 	}
 
@@ -1,362 +1,823 @@
 #include "day_17.h"
 
 #include "../common_includes.h"
+#include "../bit_utils.h"
 
-#include <algorithm>
-#include <map>
-#include <limits>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <vector>
 
-#undef min
-#undef max
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DAY_17_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
 
 PROBLEM_CLASS_CPP(17);
 
-typedef std::tuple<int, int, int, int> coord;
-coord operator-(const coord& lhs, const coord& rhs)
+static constexpr int CYCLES_TO_BOOT = 6;
+// Cells in a word of the packed grid, rows are padded to a whole number of words
+static constexpr size_t CELLS_PER_WORD = 64;
+// Byte lanes summed at once, the sums have this much slack either side so reads just past the ends stay in bounds
+static constexpr size_t SUM_LANES = 16;
+// Roughly how many dense cell passes it costs the sparse engine to add to one neighbour
+static constexpr double SPARSE_NEIGHBOUR_COST = 64.0;
+// Biggest dense grid worth allocating, past this the sparse engine is kept however dense the cubes are
+static constexpr double MAX_DENSE_CELLS = 1 << 26;
+
+// Add a saturating byte count, only counts up to 4 matter so anything past 255 can stop there
+//
+// lhs:	First count
+// rhs:	Second count
+//
+// Returns the sum, at most 255
+static inline uint8_t add_saturated(uint8_t lhs, uint8_t rhs)
 {
-	return std::make_tuple(std::get<0>(lhs) - std::get<0>(rhs), std::get<1>(lhs) - std::get<1>(rhs), std::get<2>(lhs) - std::get<2>(rhs), std::get<3>(lhs) - std::get<3>(rhs));
+	const unsigned int sum = static_cast<unsigned int>(lhs) + rhs;
+	return static_cast<uint8_t>(sum > 255 ? 255 : sum);
 }
 
-template <int component>
-void set_component(coord* cur_coord, const int& rhs, const int& (*compare) (const int&, const int&))
+// Sum three runs of counts lane by lane
+//
+// lower:		Counts one step down the axis
+// middle:		Counts at the cells
+// upper:		Counts one step up the axis
+// sums:		(Output) Sum of the three for each cell
+// num_lanes:	Number of cells, a multiple of SUM_LANES
+static void add_byte_lanes(const uint8_t* lower, const uint8_t* middle, const uint8_t* upper, uint8_t* sums, size_t num_lanes)
 {
-	std::get<component>(*cur_coord) = compare(std::get<component>(*cur_coord), rhs);
-};
+#ifdef DAY_17_HAS_SSE2
+	for (size_t lane = 0; lane < num_lanes; lane += SUM_LANES) {
+		const __m128i lower_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lower + lane));
+		const __m128i middle_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(middle + lane));
+		const __m128i upper_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(upper + lane));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + lane), _mm_adds_epu8(_mm_adds_epu8(lower_lanes, middle_lanes), upper_lanes));
+	}
+#else
+	for (size_t lane = 0; lane < num_lanes; ++lane) {
+		sums[lane] = add_saturated(add_saturated(lower[lane], middle[lane]), upper[lane]);
+	}
+#endif
+}
 
-template <int component>
-void set_component(coord* cur_coord, const coord& rhs, const int& (*compare) (const int&, const int&))
+// Sum the counts at 0 along a mirrored axis, where the cell below is the mirror of the one above
+//
+// middle:		Counts at the cells
+// upper:		Counts one step up the axis, which are counted twice
+// sums:		(Output) Sum for each cell
+// num_lanes:	Number of cells, a multiple of SUM_LANES
+static void add_mirrored_byte_lanes(const uint8_t* middle, const uint8_t* upper, uint8_t* sums, size_t num_lanes)
 {
-	set_component<component>(cur_coord, std::get<component>(rhs), compare);
-};
+	add_byte_lanes(upper, middle, upper, sums, num_lanes);
+}
+
+// Spread a word of cells out to a byte per cell
+//
+// states:	Bit per cell, set if active
+// cells:	(Output) CELLS_PER_WORD bytes, 1 if active
+static void unpack_states(uint64_t states, uint8_t* cells)
+{
+	for (size_t byte = 0; byte < CELLS_PER_WORD / 8; ++byte) {
+		// Copy the byte to every byte, keep bit i in byte i, then turn each set bit into a 1
+		uint64_t spread = ((states >> (byte * 8)) & 0xFF) * 0x0101010101010101ull;
+		spread &= 0x8040201008040201ull;
+		spread = ((spread + 0x7F7F7F7F7F7F7F7Full) & 0x8080808080808080ull) >> 7;
+		memcpy(cells + byte * 8, &spread, sizeof(spread));
+	}
+}
+
+// Apply the rules to a word of cells from their neighbourhood sums, which include the cell itself
+// An active cell with 2 or 3 active neighbours has a sum of 3 or 4, an inactive one with 3 has a sum of 3
+//
+// sums:	CELLS_PER_WORD neighbourhood sums
+// states:	Bit per cell, set if active
+//
+// Returns the next states of the cells
+static uint64_t get_next_states(const uint8_t* sums, uint64_t states)
+{
+	uint64_t sums_of_3 = 0;
+	uint64_t sums_of_4 = 0;
+#ifdef DAY_17_HAS_SSE2
+	const __m128i threes = _mm_set1_epi8(3);
+	const __m128i fours = _mm_set1_epi8(4);
+	for (size_t lane = 0; lane < CELLS_PER_WORD; lane += SUM_LANES) {
+		const __m128i sum_lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + lane));
+		sums_of_3 |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(sum_lanes, threes)))) << lane;
+		sums_of_4 |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(sum_lanes, fours)))) << lane;
+	}
+#else
+	for (size_t lane = 0; lane < CELLS_PER_WORD; ++lane) {
+		sums_of_3 |= static_cast<uint64_t>(sums[lane] == 3) << lane;
+		sums_of_4 |= static_cast<uint64_t>(sums[lane] == 4) << lane;
+	}
+#endif
+	return sums_of_3 | (sums_of_4 & states);
+}
+
+// Coordinates of a cube, the dimensions past the first 2 are never negative since only their non-negative half is stored
+template <int D>
+using cube_coords = std::array<int, D>;
+
+// Count how many cubes a stored cube stands for, itself and its mirror images across every extra dimension it's off 0 in
+//
+// cube:	The stored cube
+//
+// Returns the number of cubes
+template <int D>
+static int get_num_mirror_images(const cube_coords<D>& cube)
+{
+	int num_mirror_images = 1;
+	for (int axis = 2; axis < D; ++axis) {
+		num_mirror_images *= cube[axis] != 0 ? 2 : 1;
+	}
+	return num_mirror_images;
+}
+
+// Get the bounding box of some cubes
+//
+// cubes:	The cubes to bound
+// lower:	(Output) Lowest coordinate along each axis, 0 along the extra dimensions
+// upper:	(Output) Highest coordinate along each axis, below the lower along the first 2 if there are no cubes
+template <int D>
+static void get_cube_bounds(const std::vector<cube_coords<D>>& cubes, int* lower, int* upper)
+{
+	for (int axis = 0; axis < D; ++axis) {
+		lower[axis] = 0;
+		upper[axis] = axis < 2 ? -1 : 0;
+	}
+	for (size_t i = 0; i < cubes.size(); ++i) {
+		for (int axis = 0; axis < D; ++axis) {
+			const int coord = cubes[i][axis];
+			if (axis < 2) {
+				lower[axis] = i == 0 || coord < lower[axis] ? coord : lower[axis];
+				upper[axis] = i == 0 || coord > upper[axis] ? coord : upper[axis];
+			} else {
+				upper[axis] = coord > upper[axis] ? coord : upper[axis];
+			}
+		}
+	}
+}
+
+// Conway cubes in D dimensions, stored densely
+// Every dimension past the first 2 starts flat at 0, so the cubes stay mirrored about 0 along each of them
+// Only the non-negative half of each extra dimension is stored, which cuts the cells by about 2^(D-2)
+// A cell at 0 sees its neighbour at -1 as the mirror of the one at +1, so that neighbour is counted twice
+// The grid is a flat bitset sized up front for the growth of the cycles it will run plus a border of inactive cells
+// Each cycle unpacks it to a byte per cell and sums the 3^D neighbourhood as one pass of 3 along each axis in turn
+// Everything is allocated up front and double buffered, so nothing is allocated while cycling
+template <int D>
+class dense_pocket_dimension {
+	static_assert(D >= 2, "The slice takes 2 dimensions");
 
-// Dimensional cube holding state of active and inactive coords
-class p_dimension {
 public:
-	p_dimension(std::ifstream& input, bool four_d = false);
+	dense_pocket_dimension(const std::vector<cube_coords<D>>& cubes, int num_cycles);
 
-	void boot_up();
-	bool is_boot_done() const { return m_cycle == p_dimension::CYCLES_TO_BOOT; }
-	
-	int get_active_cubes_count() const { return m_active_cubes; }
-	void print();
+	static double get_num_cells(const int* lower, const int* upper, int num_cycles);
+
+	void next_cycle();
+
+	long long get_active_cubes_count() const { return m_active_cubes; }
+	size_t get_num_stored_cubes() const { return m_stored_cubes; }
+	size_t get_num_cells() const { return m_num_cells; }
+	void get_active_cubes(std::vector<cube_coords<D>>* cubes) const;
 
 private:
-	static constexpr unsigned int CYCLES_TO_BOOT = 6;
+	static size_t get_sizes(const int* lower, const int* upper, int num_cycles, size_t* sizes);
 
-	enum class cube_state {
-		ACTIVE,
-		INACTIVE,
-	};
+	void sum_neighbourhoods();
 
-	typedef std::vector<cube_state> dimension_row;
-	typedef std::vector<dimension_row> dimension_layer;
-	typedef std::vector<dimension_layer> dimension_space;
-	typedef std::vector<dimension_space> dimension_hyperspace;
+	// Counts every mirror image, not just the stored half
+	long long m_active_cubes = 0;
+	size_t m_stored_cubes = 0;
 
-	void next_cycle();
-	bool is_coord_valid(const coord& cur_coord) const;
-	cube_state get_cube_state(const coord& cur_coord) const;
-	cube_state get_next_cube_state(const coord& cur_coord);
-
-	bool m_is_four_d;
-	dimension_hyperspace m_hyperspace;
-	int m_active_cubes = 0;
-	unsigned int m_cycle = 0;
-
-	// The current bbox of our active coords
-	coord m_min = std::make_tuple(0, 0, 0, 0);
-	coord m_max = std::make_tuple(0, 0, 0, 0);
-
-	// The bbox of the entire lifetime of the cube
-	coord m_total_min = std::make_tuple(0, 0, 0, 0);
-	coord m_total_max = std::make_tuple(0, 0, 0, 0);
+	// Coordinates of the first cell along the first 2 axes, the extra dimensions start at 0
+	int m_offsets[2];
+	size_t m_sizes[D];
+	size_t m_strides[D];
+	size_t m_num_cells;
+
+	// Which cells of each word in a row aren't border or row padding
+	std::vector<uint64_t> m_row_masks;
+
+	// A bit per cell, set if active, m_cells[m_current] is the current cycle
+	std::vector<uint64_t> m_cells[2];
+	int m_current = 0;
+
+	// A byte per cell for the neighbourhood sums, each pass along an axis reads one and writes the other
+	std::vector<uint8_t> m_sums[2];
+	// Which of m_sums holds the finished sums
+	int m_summed = 0;
 };
 
-// Initialize a dimensional cube with input
+// Initialize the dimension with some active cubes
 //
-// input:	Input to initialize with
-// four_d:	Whether this cube is 4d or 3d
-p_dimension::p_dimension(std::ifstream& input, bool four_d/* = false*/) : m_is_four_d(four_d)
+// cubes:		The active cubes
+// num_cycles:	How many cycles the dimension will go through, which decides how far it can grow
+template <int D>
+dense_pocket_dimension<D>::dense_pocket_dimension(const std::vector<cube_coords<D>>& cubes, int num_cycles)
 {
-	dimension_layer new_layer;
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-
-		dimension_row new_row;
-		for (const char cur_cube : input_line) {
-			switch (cur_cube)
-			{
-			case '.':
-				new_row.emplace_back(cube_state::INACTIVE);
-				break;
-			case '#':
-				new_row.emplace_back(cube_state::ACTIVE);
-				++m_active_cubes;
-				break;
-			default:
-				break;
-			}
+	int lower[D];
+	int upper[D];
+	get_cube_bounds<D>(cubes, lower, upper);
+	const size_t row_width = get_sizes(lower, upper, num_cycles, m_sizes);
+	for (int axis = 0; axis < 2; ++axis) {
+		m_offsets[axis] = lower[axis] - (num_cycles + 1);
+	}
+	for (int axis = 0; axis < D; ++axis) {
+		m_strides[axis] = axis == 0 ? 1 : m_strides[axis - 1] * m_sizes[axis - 1];
+	}
+	m_num_cells = m_strides[D - 1] * m_sizes[D - 1];
+
+	m_row_masks.assign(m_sizes[0] / CELLS_PER_WORD, 0);
+	for (size_t col = 1; col + 1 < row_width; ++col) {
+		m_row_masks[col / CELLS_PER_WORD] |= 1ull << (col % CELLS_PER_WORD);
+	}
+
+	m_cells[0].assign(m_num_cells / CELLS_PER_WORD, 0);
+	m_cells[1].assign(m_cells[0].size(), 0);
+	m_sums[0].assign(m_num_cells + 2 * SUM_LANES, 0);
+	m_sums[1].assign(m_sums[0].size(), 0);
+
+	for (const cube_coords<D>& cube : cubes) {
+		size_t cell = 0;
+		for (int axis = 0; axis < D; ++axis) {
+			cell += (axis < 2 ? cube[axis] - m_offsets[axis] : cube[axis]) * m_strides[axis];
 		}
-		new_layer.push_back(new_row);
+		m_cells[m_current][cell / CELLS_PER_WORD] |= 1ull << (cell % CELLS_PER_WORD);
+		++m_stored_cubes;
+		m_active_cubes += get_num_mirror_images<D>(cube);
 	}
-	// Store our current max bbox
-	// The min is 0, 0
-	std::get<0>(m_max) = new_layer.empty() ? -1 : new_layer[0].size() - 1;
-	std::get<1>(m_max) = new_layer.size() - 1;
-	m_total_max = m_max;
+}
 
-	dimension_space new_space;
-	new_space.emplace_back(new_layer);
-	m_hyperspace.emplace_back(new_space);
+// Work out how big the grid has to be along each axis
+// Each cycle can grow one cell along every axis, with a border past that, but only upwards along the mirrored ones
+//
+// lower:		Lowest coordinate of the active cubes along each axis
+// upper:		Highest coordinate of the active cubes along each axis
+// num_cycles:	How many cycles the grid has to have room for
+// sizes:		(Output) The size along each axis, the first is padded to whole words
+//
+// Returns the width of a row before padding
+template <int D>
+size_t dense_pocket_dimension<D>::get_sizes(const int* lower, const int* upper, int num_cycles, size_t* sizes)
+{
+	const size_t margin = static_cast<size_t>(num_cycles) + 1;
+	const size_t row_width = static_cast<size_t>(upper[0] - lower[0] + 1) + 2 * margin;
+	sizes[0] = (row_width + CELLS_PER_WORD - 1) / CELLS_PER_WORD * CELLS_PER_WORD;
+	sizes[1] = static_cast<size_t>(upper[1] - lower[1] + 1) + 2 * margin;
+	for (int axis = 2; axis < D; ++axis) {
+		sizes[axis] = static_cast<size_t>(upper[axis]) + 1 + margin;
+	}
+	return row_width;
 }
 
-// Is the coordinate valid without our current bbox
+// Work out how many cells a grid would need, without overflowing however big it is
 //
-// cur_coord:	Coord to test
+// lower:		Lowest coordinate of the active cubes along each axis
+// upper:		Highest coordinate of the active cubes along each axis
+// num_cycles:	How many cycles the grid has to have room for
 //
-// Returns true if it is valid
-bool p_dimension::is_coord_valid(const coord& cur_coord) const
+// Returns the number of cells
+template <int D>
+double dense_pocket_dimension<D>::get_num_cells(const int* lower, const int* upper, int num_cycles)
 {
-	if (std::get<0>(cur_coord) < std::get<0>(m_min) || std::get<0>(cur_coord) > std::get<0>(m_max)) {
-		return false;
+	size_t sizes[D];
+	get_sizes(lower, upper, num_cycles, sizes);
+	double num_cells = 1.0;
+	for (const size_t size : sizes) {
+		num_cells *= static_cast<double>(size);
 	}
-	if (std::get<1>(cur_coord) < std::get<1>(m_min) || std::get<1>(cur_coord) > std::get<1>(m_max)) {
-		return false;
+	return num_cells;
+}
+
+// Get every stored active cube
+//
+// cubes:	(Output) The active cubes
+template <int D>
+void dense_pocket_dimension<D>::get_active_cubes(std::vector<cube_coords<D>>* cubes) const
+{
+	cubes->clear();
+	const std::vector<uint64_t>& cells = m_cells[m_current];
+	for (size_t word = 0; word < cells.size(); ++word) {
+		for (uint64_t states = cells[word]; states != 0; states &= states - 1) {
+			size_t cell = word * CELLS_PER_WORD + count_trailing_zeros_64(states);
+			cube_coords<D> cube;
+			for (int axis = D - 1; axis >= 0; --axis) {
+				cube[axis] = static_cast<int>(cell / m_strides[axis]) + (axis < 2 ? m_offsets[axis] : 0);
+				cell %= m_strides[axis];
+			}
+			cubes->push_back(cube);
+		}
 	}
-	if (std::get<2>(cur_coord) < std::get<2>(m_min) || std::get<2>(cur_coord) > std::get<2>(m_max)) {
-		return false;
+}
+
+// Sum every cell's neighbourhood, including itself, into m_sums[m_summed]
+// Border cells end up with sums mixing in the cells on the other side of the wrap, but they're never used
+template <int D>
+void dense_pocket_dimension<D>::sum_neighbourhoods()
+{
+	uint8_t* sums = m_sums[0].data() + SUM_LANES;
+	uint8_t* next_sums = m_sums[1].data() + SUM_LANES;
+	m_summed = 1;
+
+	const std::vector<uint64_t>& cells = m_cells[m_current];
+	for (size_t word = 0; word < cells.size(); ++word) {
+		unpack_states(cells[word], sums + word * CELLS_PER_WORD);
 	}
-	if (std::get<3>(cur_coord) < std::get<3>(m_min) || std::get<3>(cur_coord) > std::get<3>(m_max)) {
-		return false;
+
+	// The first axis is contiguous, so the whole grid is summed in one go
+	add_byte_lanes(sums - 1, sums, sums + 1, next_sums, m_num_cells);
+
+	// Every other axis sums whole runs of cells a stride apart, one slab of the axis at a time
+	for (int axis = 1; axis < D; ++axis) {
+		uint8_t* const swap_sums = sums;
+		sums = next_sums;
+		next_sums = swap_sums;
+		m_summed ^= 1;
+
+		const size_t stride = m_strides[axis];
+		const size_t slab = stride * m_sizes[axis];
+		for (size_t base = 0; base < m_num_cells; base += slab) {
+			if (axis >= 2) {
+				add_mirrored_byte_lanes(sums + base, sums + base + stride, next_sums + base, stride);
+			}
+			add_byte_lanes(sums + base, sums + base + stride, sums + base + 2 * stride, next_sums + base + stride, slab - 2 * stride);
+		}
 	}
+}
 
-	return true;
+// Determine the next cycle for the dimension
+template <int D>
+void dense_pocket_dimension<D>::next_cycle()
+{
+	sum_neighbourhoods();
+	const uint8_t* const sums = m_sums[m_summed].data() + SUM_LANES;
+	const std::vector<uint64_t>& cells = m_cells[m_current];
+	std::vector<uint64_t>& next_cells = m_cells[m_current ^ 1];
+	m_active_cubes = 0;
+	m_stored_cubes = 0;
+
+	// Only rows off the border are updated, the border rows of both buffers stay inactive
+	size_t coords[D];
+	for (int axis = 1; axis < D; ++axis) {
+		coords[axis] = axis < 2 ? 1 : 0;
+	}
+	const size_t words_per_row = m_row_masks.size();
+	for (;;) {
+		size_t row_start = 0;
+		int num_mirror_images = 1;
+		for (int axis = 1; axis < D; ++axis) {
+			row_start += coords[axis] * m_strides[axis];
+			num_mirror_images *= axis >= 2 && coords[axis] != 0 ? 2 : 1;
+		}
+
+		const size_t row_word = row_start / CELLS_PER_WORD;
+		int row_active_cubes = 0;
+		for (size_t word = 0; word < words_per_row; ++word) {
+			const uint64_t next_states = get_next_states(sums + (row_word + word) * CELLS_PER_WORD, cells[row_word + word]) & m_row_masks[word];
+			next_cells[row_word + word] = next_states;
+			row_active_cubes += popcount_64(next_states);
+		}
+		m_stored_cubes += row_active_cubes;
+		m_active_cubes += static_cast<long long>(row_active_cubes) * num_mirror_images;
+
+		int axis = 1;
+		for (; axis < D; ++axis) {
+			if (++coords[axis] + 1 < m_sizes[axis]) {
+				break;
+			}
+			coords[axis] = axis < 2 ? 1 : 0;
+		}
+		if (axis == D) {
+			break;
+		}
+	}
+
+	m_current ^= 1;
+}
+
+// Conway cubes in D dimensions, stored sparsely as the set of active cubes with the same mirroring as the dense grid
+// Each cube is a key packing a biased coordinate per axis into 64 bits, so stepping to a neighbour is adding an offset
+// Each cycle every active cube adds its weight to each of its neighbours in an open addressing table of counts,
+// then the table is scanned for the cubes that stay or become active
+// The cost follows the active cubes times 3^D instead of the volume of their bounding box, and there's no limit on how far they grow
+// beyond what a key can hold
+template <int D>
+class sparse_pocket_dimension {
+	static_assert(D >= 2, "The slice takes 2 dimensions");
+
+public:
+	sparse_pocket_dimension(const std::vector<cube_coords<D>>& cubes);
+
+	bool can_cycle() const;
+	void next_cycle();
+
+	long long get_active_cubes_count() const { return m_active_cubes; }
+	size_t get_num_stored_cubes() const { return m_active.size(); }
+	void get_bounds(int* lower, int* upper) const;
+	void get_active_cubes(std::vector<cube_coords<D>>* cubes) const;
+
+private:
+	static constexpr int BITS_PER_AXIS = 64 / D < 31 ? 64 / D : 31;
+	static constexpr uint64_t AXIS_MASK = (1ull << BITS_PER_AXIS) - 1;
+	static constexpr int AXIS_BIAS = 1 << (BITS_PER_AXIS - 1);
+	// Coordinates are kept off the highest value along every axis, so this is never a key
+	static constexpr uint64_t EMPTY_KEY = ~0ull;
+	// Added to a cube's own count when it's active, above any count of neighbours
+	static constexpr uint32_t ACTIVE_FLAG = 1u << 31;
+
+	// A neighbour to add to, as the offset between their keys and how many times it's counted
+	struct neighbour {
+		uint64_t m_offset;
+		uint32_t m_weight;
+	};
+
+	// A cube's count in the table, kept together so a probe touches one cache line
+	struct count_slot {
+		uint64_t m_key;
+		uint32_t m_count;
+	};
+
+	static uint64_t pack(const cube_coords<D>& cube);
+	static int get_coord(uint64_t key, int axis) { return static_cast<int>((key >> (axis * BITS_PER_AXIS)) & AXIS_MASK) - AXIS_BIAS; }
+	static int get_mirror_pattern(uint64_t key);
+
+	const std::vector<neighbour>& get_neighbours(int mirror_pattern);
+	void add_count(uint64_t key, uint32_t count);
+	void grow();
+
+	long long m_active_cubes = 0;
+	std::vector<uint64_t> m_active;
+	std::vector<uint64_t> m_next_active;
+	int m_lower[D];
+	int m_upper[D];
+
+	// Open addressing table of counts, the size is always a power of 2 and kept at most half full, and it's reused each cycle
+	std::vector<count_slot> m_slots;
+	size_t m_num_keys = 0;
+	// Fibonacci hashing keeps the top bits of the product, which every bit of the key feeds into
+	int m_hash_shift = 64 - 10;
+
+	// The neighbours of a cube for each mirror pattern, worked out the first time the pattern is seen
+	std::vector<std::vector<neighbour>> m_neighbours;
+};
+
+template <int D>
+constexpr uint64_t sparse_pocket_dimension<D>::EMPTY_KEY;
+
+// Initialize the dimension with some active cubes
+//
+// cubes:	The active cubes, which have to fit in a key
+template <int D>
+sparse_pocket_dimension<D>::sparse_pocket_dimension(const std::vector<cube_coords<D>>& cubes)
+{
+	int num_mirror_patterns = 1;
+	for (int axis = 2; axis < D; ++axis) {
+		num_mirror_patterns *= 3;
+	}
+	m_neighbours.resize(num_mirror_patterns);
+	m_slots.assign(static_cast<size_t>(1) << (64 - m_hash_shift), count_slot{ EMPTY_KEY, 0 });
+
+	get_cube_bounds<D>(cubes, m_lower, m_upper);
+	for (const cube_coords<D>& cube : cubes) {
+		m_active.push_back(pack(cube));
+		m_active_cubes += get_num_mirror_images<D>(cube);
+	}
 }
 
-// Get the cube state for the given coordinate
+// Pack a cube into a key
 //
-// cur_coord:	Coord to check
+// cube:	The cube to pack
 //
-// Returns the cube state at that coordinate
-p_dimension::cube_state p_dimension::get_cube_state(const coord& cur_coord) const
+// Returns the key
+template <int D>
+uint64_t sparse_pocket_dimension<D>::pack(const cube_coords<D>& cube)
 {
-	if (!is_coord_valid(cur_coord)) {
-		return cube_state::INACTIVE;
+	uint64_t key = 0;
+	for (int axis = 0; axis < D; ++axis) {
+		key |= static_cast<uint64_t>(cube[axis] + AXIS_BIAS) << (axis * BITS_PER_AXIS);
 	}
-	coord zeroed_coord = cur_coord - m_min;
-	return m_hyperspace[std::get<3>(zeroed_coord)][std::get<2>(zeroed_coord)][std::get<1>(zeroed_coord)][std::get<0>(zeroed_coord)];
+	return key;
 }
 
-// Get the next cube state for a given coordinate
+// Get which neighbours a cube has across 0 in each extra dimension
+// Each extra dimension is a base 3 digit, 0 if the cube is at 0, 1 if it's at 1, otherwise 2
 //
-// cur_coord:	Coord to check
+// key:	The cube's key
 //
-// Returns the next cube state at that coordinate
-p_dimension::cube_state p_dimension::get_next_cube_state(const coord& cur_coord)
+// Returns the pattern
+template <int D>
+int sparse_pocket_dimension<D>::get_mirror_pattern(uint64_t key)
 {
-	int cubes_active = 0;
-	// Search all neighbors
-	for (int space_offset = (m_is_four_d ? -1 : 0); space_offset < (m_is_four_d ? 2 : 1); ++space_offset) {
-		for (int layer_offset = -1; layer_offset < 2; ++layer_offset) {
-			for (int row_offset = -1; row_offset < 2; ++row_offset) {
-				for (int col_offset = -1; col_offset < 2; ++col_offset) {
-					// Don't check ourself
-					if ((space_offset | layer_offset | row_offset | col_offset) == 0) {
-						continue;
-					}
-					if (get_cube_state(std::make_tuple(std::get<0>(cur_coord) + col_offset, std::get<1>(cur_coord) + row_offset, std::get<2>(cur_coord) + layer_offset, std::get<3>(cur_coord) + space_offset)) == cube_state::ACTIVE) {
-						if (++cubes_active > 3) {
-							break;
-						}
-					}
-				}
-				if (cubes_active > 3) {
-					break;
-				}
-			}
-			if (cubes_active > 3) {
-				break;
+	int mirror_pattern = 0;
+	int place = 1;
+	for (int axis = 2; axis < D; ++axis, place *= 3) {
+		const int coord = get_coord(key, axis);
+		mirror_pattern += (coord == 0 ? 0 : (coord == 1 ? 1 : 2)) * place;
+	}
+	return mirror_pattern;
+}
+
+// Get the neighbours a cube adds to for a mirror pattern
+// Nothing is added below 0 in an extra dimension, the cube at -1 is the mirror of the one at +1 which is already added to
+// A cube at 1 is the neighbour of the cube at 0 twice, from this side and as its mirror at -1
+//
+// mirror_pattern:	The cube's mirror pattern
+//
+// Returns the neighbours
+template <int D>
+const std::vector<typename sparse_pocket_dimension<D>::neighbour>& sparse_pocket_dimension<D>::get_neighbours(int mirror_pattern)
+{
+	std::vector<neighbour>& neighbours = m_neighbours[mirror_pattern];
+	if (!neighbours.empty()) {
+		return neighbours;
+	}
+
+	int num_neighbourhoods = 1;
+	for (int axis = 0; axis < D; ++axis) {
+		num_neighbourhoods *= 3;
+	}
+	for (int neighbourhood = 0; neighbourhood < num_neighbourhoods; ++neighbourhood) {
+		// Don't count ourself, which is the middle of the neighbourhood
+		if (neighbourhood == num_neighbourhoods / 2) {
+			continue;
+		}
+
+		neighbour cur_neighbour = { 0, 1 };
+		bool is_mirrored_away = false;
+		int digits = neighbourhood;
+		int mirror_digits = mirror_pattern;
+		for (int axis = 0; axis < D; ++axis, digits /= 3) {
+			const int step = digits % 3 - 1;
+			if (axis >= 2) {
+				const int mirror_digit = mirror_digits % 3;
+				mirror_digits /= 3;
+				is_mirrored_away |= step < 0 && mirror_digit == 0;
+				cur_neighbour.m_weight *= step < 0 && mirror_digit == 1 ? 2 : 1;
 			}
+			cur_neighbour.m_offset += static_cast<uint64_t>(static_cast<int64_t>(step)) << (axis * BITS_PER_AXIS);
 		}
-		if (cubes_active > 3) {
-			break;
+		if (!is_mirrored_away) {
+			neighbours.push_back(cur_neighbour);
 		}
 	}
-
-	return cubes_active == 3 ? cube_state::ACTIVE : (cubes_active == 2 && get_cube_state(cur_coord) == cube_state::ACTIVE ? cube_state::ACTIVE : cube_state::INACTIVE);
+	return neighbours;
 }
 
-// Determine the next cycle for the cube
-void p_dimension::next_cycle()
+// Add to the count of a cube, putting it in the table if it isn't already
+//
+// key:		The cube's key
+// count:	What to add
+template <int D>
+void sparse_pocket_dimension<D>::add_count(uint64_t key, uint32_t count)
 {
-	m_active_cubes = 0;
-	
-	dimension_hyperspace next_hyperspace;
-	coord next_min = std::make_tuple(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
-	coord next_max = std::make_tuple(std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
-
-	// Get the next state for each coordiante
-	for (int space = (m_is_four_d ? std::get<3>(m_min) - 1 : 0); space <= (m_is_four_d ? std::get<3>(m_max) + 1 : 0); ++space) {
-		dimension_space next_space;
-		bool space_has_active_cube = false;
-		for (int layer = std::get<2>(m_min) - 1; layer <= std::get<2>(m_max) + 1; ++layer) {
-			dimension_layer next_layer;
-			bool layer_has_active_cube = false;
-			for (int row = std::get<1>(m_min) - 1; row <= std::get<1>(m_max) + 1; ++row) {
-				dimension_row next_row;
-				bool row_has_active_cube = false;
-				for (int col = std::get<0>(m_min) - 1; col <= std::get<0>(m_max) + 1; ++col) {
-					coord next_coord = std::make_tuple(col, row, layer, space);
-					cube_state next_state = get_next_cube_state(next_coord);
-					next_row.push_back(next_state);
-
-					// If the coordinate is active
-					if (next_state == cube_state::ACTIVE) {
-						// Update number of active cubes and cache that there is an active cube in each dimension
-						++m_active_cubes;
-						row_has_active_cube = true;
-						layer_has_active_cube = true;
-						space_has_active_cube = true;
-
-						// Update the mins and maxes for this dimension
-						set_component<0>(&next_min, next_coord, std::min);
-						set_component<0>(&next_max, next_coord, std::max);
-						set_component<0>(&m_total_min, next_coord, std::min);
-						set_component<0>(&m_total_max, next_coord, std::max);
-					}
-				}
-
-				next_layer.push_back(next_row);
-				// If there was an active cube, update the mins and maxes for this dimension
-				if (row_has_active_cube) {
-					set_component<1>(&next_min, row, std::min);
-					set_component<1>(&next_max, row, std::max);
-					set_component<1>(&m_total_min, row, std::min);
-					set_component<1>(&m_total_max, row, std::max);
-				}
-			}
-						
-			next_space.push_back(next_layer);
-			// If there was an active cube, update the mins and maxes for this dimension
-			if (layer_has_active_cube) {
-				set_component<2>(&next_min, layer, std::min);
-				set_component<2>(&next_max, layer, std::max);
-				set_component<2>(&m_total_min, layer, std::min);
-				set_component<2>(&m_total_max, layer, std::max);
+	const size_t slot_mask = m_slots.size() - 1;
+	size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> m_hash_shift);
+	while (m_slots[slot].m_key != key) {
+		if (m_slots[slot].m_key == EMPTY_KEY) {
+			m_slots[slot].m_key = key;
+			m_slots[slot].m_count = count;
+			if (++m_num_keys * 2 > m_slots.size()) {
+				grow();
 			}
+			return;
 		}
+		slot = (slot + 1) & slot_mask;
+	}
+	m_slots[slot].m_count += count;
+}
 
-		// If there's been an active cube, then we need to add this space
-		if (m_active_cubes > 0) {
-			next_hyperspace.push_back(next_space);
-		}
-		// If there was an active cube, update the mins and maxes for this dimension
-		if (space_has_active_cube) {
-			set_component<3>(&next_min, space, std::min);
-			set_component<3>(&next_max, space, std::max);
-			set_component<3>(&m_total_min, space, std::min);
-			set_component<3>(&m_total_max, space, std::max);
+// Double the table, rehashing every count
+template <int D>
+void sparse_pocket_dimension<D>::grow()
+{
+	std::vector<count_slot> old_slots(m_slots.size() * 2, count_slot{ EMPTY_KEY, 0 });
+	old_slots.swap(m_slots);
+	--m_hash_shift;
+	m_num_keys = 0;
+	for (const count_slot& old_slot : old_slots) {
+		if (old_slot.m_key != EMPTY_KEY) {
+			add_count(old_slot.m_key, old_slot.m_count);
 		}
 	}
+}
 
-	// Determine the new sizes to know which parts are empty and can be skimmed
-	int extra_cols = std::get<0>(next_min) - (std::get<0>(m_min) - 1);
-	int new_col_size = std::get<0>(next_max) - std::get<0>(next_min) + 1;
-	int extra_rows = std::get<1>(next_min) - (std::get<1>(m_min) - 1);
-	int new_row_size = std::get<1>(next_max) - std::get<1>(next_min) + 1;
-	int extra_layers = std::get<2>(next_min) - (std::get<2>(m_min) - 1);
-	int new_layer_size = std::get<2>(next_max) - std::get<2>(next_min) + 1;
-	int new_space_size = std::get<3>(next_max) - std::get<3>(next_min) + 1;
+// Determine if the next cycle can still be held by the keys
+//
+// Returns true if every cube and its neighbours stay off the ends of every axis
+template <int D>
+bool sparse_pocket_dimension<D>::can_cycle() const
+{
+	for (int axis = 0; axis < D; ++axis) {
+		if (m_lower[axis] - 1 <= -AXIS_BIAS || m_upper[axis] + 1 >= AXIS_BIAS - 1) {
+			return false;
+		}
+	}
+	return true;
+}
 
-	// Remove hyperspaces at the beginning that were empty
-	if (new_space_size < static_cast<int>(next_hyperspace.size())) {
-		next_hyperspace.resize(new_space_size);
+// Determine the next cycle for the dimension, which has to be able to cycle
+template <int D>
+void sparse_pocket_dimension<D>::next_cycle()
+{
+	// Only clear the table, it keeps the size of the busiest cycle so far
+	for (count_slot& slot : m_slots) {
+		slot.m_key = EMPTY_KEY;
 	}
-	for (auto& space : next_hyperspace) {
-		// Remove empty layers on bottom
-		if (extra_layers > 0) {
-			space.erase(space.begin(), space.begin() + extra_layers);
-		}
-		// Remove empty layers on top
-		if (new_layer_size < static_cast<int>(space.size())) {
-			space.resize(new_layer_size);
+	m_num_keys = 0;
+	for (const uint64_t key : m_active) {
+		add_count(key, ACTIVE_FLAG);
+		for (const neighbour& cur_neighbour : get_neighbours(get_mirror_pattern(key))) {
+			add_count(key + cur_neighbour.m_offset, cur_neighbour.m_weight);
 		}
+	}
 
-		// Check remaining layers
-		for (auto& layer : space) {
-			// Remove empty rows on the top
-			if (extra_rows > 0) {
-				layer.erase(layer.begin(), layer.begin() + extra_rows);
-			}
-			// Remove empty rows on the bottom
-			if (new_row_size < static_cast<int>(layer.size())) {
-				layer.resize(new_row_size);
-			}
+	m_next_active.clear();
+	m_active_cubes = 0;
+	for (const count_slot& slot : m_slots) {
+		const uint64_t key = slot.m_key;
+		if (key == EMPTY_KEY) {
+			continue;
+		}
+		const uint32_t active_neighbours = slot.m_count & ~ACTIVE_FLAG;
+		if (active_neighbours != 3 && (active_neighbours != 2 || (slot.m_count & ACTIVE_FLAG) == 0)) {
+			continue;
+		}
 
-			for (auto& row : layer) {
-				// Remove empty coordinates on the left
-				if (extra_cols > 0) {
-					row.erase(row.begin(), row.begin() + extra_cols);
-				}
-				// Remove empty coordinates on the right
-				if (new_col_size < static_cast<int>(row.size())) {
-					row.resize(new_col_size);
-				}
+		int num_mirror_images = 1;
+		for (int axis = 0; axis < D; ++axis) {
+			const int coord = get_coord(key, axis);
+			if (m_next_active.empty()) {
+				m_lower[axis] = axis < 2 ? coord : 0;
+				m_upper[axis] = coord;
+			} else {
+				m_lower[axis] = coord < m_lower[axis] ? coord : m_lower[axis];
+				m_upper[axis] = coord > m_upper[axis] ? coord : m_upper[axis];
 			}
+			num_mirror_images *= axis >= 2 && coord != 0 ? 2 : 1;
 		}
+		m_next_active.push_back(key);
+		m_active_cubes += num_mirror_images;
 	}
+	m_active.swap(m_next_active);
 
-	m_hyperspace.swap(next_hyperspace);
+	if (m_active.empty()) {
+		get_cube_bounds<D>(std::vector<cube_coords<D>>(), m_lower, m_upper);
+	}
+}
 
-	// Reset bbox if there's no active cubes
-	if (m_active_cubes == 0) {
-		next_min = std::make_tuple(0, 0, 0, 0);
-		next_max = std::make_tuple(0, 0, 0, 0);
+// Get the bounding box of the active cubes
+//
+// lower:	(Output) Lowest coordinate along each axis, 0 along the extra dimensions
+// upper:	(Output) Highest coordinate along each axis, below the lower along the first 2 if there are no cubes
+template <int D>
+void sparse_pocket_dimension<D>::get_bounds(int* lower, int* upper) const
+{
+	for (int axis = 0; axis < D; ++axis) {
+		lower[axis] = m_lower[axis];
+		upper[axis] = m_upper[axis];
 	}
+}
 
-	m_min = next_min;
-	m_max = next_max;
+// Get every stored active cube
+//
+// cubes:	(Output) The active cubes
+template <int D>
+void sparse_pocket_dimension<D>::get_active_cubes(std::vector<cube_coords<D>>* cubes) const
+{
+	cubes->clear();
+	for (const uint64_t key : m_active) {
+		cube_coords<D> cube;
+		for (int axis = 0; axis < D; ++axis) {
+			cube[axis] = get_coord(key, axis);
+		}
+		cubes->push_back(cube);
+	}
+}
 
-	++m_cycle;
+// Read the starting slice
+//
+// input:	Input to read from, a row of '#' and '.' per line
+//
+// Returns the rows of the slice
+static std::vector<std::string> read_slice(std::ifstream& input)
+{
+	std::vector<std::string> slice;
+	std::string input_line;
+	while (std::getline(input, input_line)) {
+		if (!input_line.empty() && input_line.back() == '\r') {
+			input_line.pop_back();
+		}
+		if (!input_line.empty()) {
+			slice.push_back(input_line);
+		}
+	}
+	return slice;
 }
 
-// Boot up the cube and go through the initial cycles
-void p_dimension::boot_up()
+// Get the active cubes of the starting slice
+//
+// slice:	Rows of the starting slice, '#' is active
+//
+// Returns the active cubes, flat at 0 in every extra dimension
+template <int D>
+static std::vector<cube_coords<D>> get_slice_cubes(const std::vector<std::string>& slice)
 {
-	while (!is_boot_done()) {
-		next_cycle();
+	std::vector<cube_coords<D>> cubes;
+	for (size_t row = 0; row < slice.size(); ++row) {
+		for (size_t col = 0; col < slice[row].size(); ++col) {
+			if (slice[row][col] == '#') {
+				cube_coords<D> cube = {};
+				cube[0] = static_cast<int>(col);
+				cube[1] = static_cast<int>(row);
+				cubes.push_back(cube);
+			}
+		}
 	}
+	return cubes;
 }
 
-// Print the current cube state
-void p_dimension::print()
+// Estimate the cost of a sparse cycle, in dense cell passes
+//
+// num_stored_cubes:	Active cubes being stored
+//
+// Returns the cost
+template <int D>
+static double get_sparse_cycle_cost(size_t num_stored_cubes)
+{
+	double num_neighbourhoods = 1.0;
+	for (int axis = 0; axis < D; ++axis) {
+		num_neighbourhoods *= 3.0;
+	}
+	return static_cast<double>(num_stored_cubes) * num_neighbourhoods * SPARSE_NEIGHBOUR_COST;
+}
+
+// Estimate the cost of a dense cycle, in dense cell passes
+//
+// num_cells:	Cells in the dense grid
+//
+// Returns the cost
+template <int D>
+static double get_dense_cycle_cost(double num_cells)
+{
+	// A pass to unpack, one along each axis and one to apply the rules
+	return num_cells * (D + 2);
+}
+
+// Boot up a pocket dimension, switching between the sparse and dense engines as the density of the cubes changes
+// It starts sparse, moves to dense once the cubes fill enough of their bounding box, and back again if they thin out
+//
+// slice:		Rows of the starting slice, '#' is active
+// num_cycles:	How many cycles to go through
+// num_active:	(Output) How many cubes are active once booted
+//
+// Returns true if the cubes could be held all the way through
+template <int D>
+static bool boot_pocket_dimension(const std::vector<std::string>& slice, int num_cycles, long long* num_active)
 {
-	std::cout << "Cycle: " << m_cycle << " Cubes: " << m_active_cubes << "\n\n";
-	for (int w = std::get<3>(m_total_min); w <= std::get<3>(m_total_max); ++w) {
-		for (int z = std::get<2>(m_total_min); z <= std::get<2>(m_total_max); ++z) {
-			std::cout << "Z: " << z << " W: " << w << '\n' << "  ";
-			for (int x = std::get<0>(m_total_min) - 1; x <= std::get<0>(m_total_max) + 1; ++x) {
-				if (x > -1 && x < 10) {
-					std::cout << ' ';
-				}
-				std::cout << x << ' ';
+	std::vector<cube_coords<D>> cubes = get_slice_cubes<D>(slice);
+	std::unique_ptr<sparse_pocket_dimension<D>> sparse = std::make_unique<sparse_pocket_dimension<D>>(cubes);
+	std::unique_ptr<dense_pocket_dimension<D>> dense;
+
+	for (int cycle = 0; cycle < num_cycles; ++cycle) {
+		const int cycles_left = num_cycles - cycle;
+		if (sparse) {
+			int lower[D];
+			int upper[D];
+			sparse->get_bounds(lower, upper);
+			// The dense grid is sized for every cycle left, so it's allocated once however long it's kept
+			const double dense_cells = dense_pocket_dimension<D>::get_num_cells(lower, upper, cycles_left);
+			const bool fits_dense = dense_cells <= MAX_DENSE_CELLS;
+			// Only switch once the other engine is clearly cheaper, so they don't keep swapping back and forth
+			if (fits_dense && (!sparse->can_cycle() || get_dense_cycle_cost<D>(dense_cells) * 2 < get_sparse_cycle_cost<D>(sparse->get_num_stored_cubes()))) {
+				sparse->get_active_cubes(&cubes);
+				sparse.reset();
+				dense = std::make_unique<dense_pocket_dimension<D>>(cubes, cycles_left);
+			} else if (!sparse->can_cycle()) {
+				return false;
 			}
-			std::cout << '\n';
-			for (int y = std::get<1>(m_total_min) - 1; y <= std::get<1>(m_total_max) + 1; ++y) {
-				if (y > -1 && y < 10) {
-					std::cout << ' ';
-				}
-				std::cout << y << ' ';
-				for (int x = std::get<0>(m_total_min) - 1; x <= std::get<0>(m_total_max) + 1; ++x) {
-					std::cout << (get_cube_state(coord(x, y, z, w)) == cube_state::ACTIVE ? '@' : '.') << "  ";
-				}
-				std::cout << '\n';
+		} else if (get_sparse_cycle_cost<D>(dense->get_num_stored_cubes()) * 2 < get_dense_cycle_cost<D>(static_cast<double>(dense->get_num_cells()))) {
+			dense->get_active_cubes(&cubes);
+			dense.reset();
+			sparse = std::make_unique<sparse_pocket_dimension<D>>(cubes);
+			// The keys can't hold as far as the grid reaches, so stay dense
+			if (!sparse->can_cycle()) {
+				sparse.reset();
+				dense = std::make_unique<dense_pocket_dimension<D>>(cubes, cycles_left);
 			}
-			std::cout << '\n';
+		}
+
+		if (sparse) {
+			sparse->next_cycle();
+		} else {
+			dense->next_cycle();
 		}
 	}
+
+	*num_active = sparse ? sparse->get_active_cubes_count() : dense->get_active_cubes_count();
+	return true;
 }
 
 /*
@@ -375,13 +836,21 @@ void p_dimension::print()
 void problem_1::solve(const std::string& file_name)
 {
 	std::ifstream input(file_name);
-	p_dimension cur_dimension(input);
+
+	if (!input.is_open()) {
+		return;
+	}
+
+	const std::vector<std::string> slice = read_slice(input);
 	input.close();
 
-	cur_dimension.boot_up();
+	long long num_active = 0;
+	if (!boot_pocket_dimension<3>(slice, CYCLES_TO_BOOT, &num_active)) {
+		return;
+	}
 
 	std::string answer;
-	answer = std::to_string(cur_dimension.get_active_cubes_count());
+	answer = std::to_string(num_active);
 	output_answer(answer);
 }
 
@@ -395,12 +864,20 @@ void problem_1::solve(const std::string& file_name)
 void problem_2::solve(const std::string& file_name)
 {
 	std::ifstream input(file_name);
-	p_dimension cur_dimension(input, true);
+
+	if (!input.is_open()) {
+		return;
+	}
+
+	const std::vector<std::string> slice = read_slice(input);
 	input.close();
 
-	cur_dimension.boot_up();
+	long long num_active = 0;
+	if (!boot_pocket_dimension<4>(slice, CYCLES_TO_BOOT, &num_active)) {
+		return;
+	}
 
 	std::string answer;
-	answer = std::to_string(cur_dimension.get_active_cubes_count());
+	answer = std::to_string(num_active);
 	output_answer(answer);
 }
\ No newline at end of file
@@ -2,18 +2,170 @@
 
 #include "../common_includes.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define DAY_5_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
 PROBLEM_CLASS_CPP(5);
 
 static constexpr int PASS_NUM_ROW_DIGS		= 7;
 static constexpr int PASS_NUM_COL_DIGS		= 3;
 static constexpr int PASS_NUM_DIGS			= PASS_NUM_ROW_DIGS + PASS_NUM_COL_DIGS;
 static constexpr char PASS_BACK_ROW_CHAR	= 'B';
-static constexpr char PASS_FRONT_ROW_CHAR	= 'F';
-static constexpr char PASS_LEFT_COL_CHAR	= 'L';
-static constexpr char PASS_RIGHT_COL_CHAR = 'R';
+static constexpr char PASS_RIGHT_COL_CHAR	= 'R';
+
+// Characters classified at once, a block spans several passes so every load is shared between them
+static constexpr size_t PASS_BLOCK_SIZE = 64;
+// Bytes read from the manifest at a time
+static constexpr size_t MANIFEST_CHUNK_SIZE = 1 << 16;
+// A block is always classified in full from the start of a pass, so keep that much readable past the end
+static constexpr size_t MANIFEST_CHUNK_PADDING = PASS_BLOCK_SIZE;
+
+// Reverse the lowest PASS_NUM_DIGS bits so the first character of the pass ends up as the highest bit
+//
+// bits:	Bits where bit 0 is the first character of the pass
+//
+// Returns the seat id
+static constexpr unsigned int reverse_pass_bits(unsigned int bits)
+{
+	bits = ((bits & 0x5555) << 1) | ((bits >> 1) & 0x5555);
+	bits = ((bits & 0x3333) << 2) | ((bits >> 2) & 0x3333);
+	bits = ((bits & 0x0F0F) << 4) | ((bits >> 4) & 0x0F0F);
+	bits = ((bits & 0x00FF) << 8) | ((bits >> 8) & 0x00FF);
+	return bits >> (16 - PASS_NUM_DIGS);
+}
+
+// XOR of every number from 0 to n
+//
+// n:	The last number to include
+//
+// Returns the XOR of [0, n]
+static constexpr unsigned int xor_up_to(unsigned int n)
+{
+	switch (n & 3) {
+	case 0:
+		return n;
+	case 1:
+		return 1;
+	case 2:
+		return n + 1;
+	default:
+		return 0;
+	}
+}
+
+// Find which characters of a block are B or R, the characters that set a bit of the seat id
+//
+// chars:	The first character of the block, there must be PASS_BLOCK_SIZE readable bytes
+//
+// Returns a bit per character, bit i set if chars[i] is B or R
+static inline uint64_t classify_pass_block(const char* chars)
+{
+	uint64_t block = 0;
+#ifdef DAY_5_USE_SSE2
+	const __m128i back_row = _mm_set1_epi8(PASS_BACK_ROW_CHAR);
+	const __m128i right_col = _mm_set1_epi8(PASS_RIGHT_COL_CHAR);
+	for (size_t lane = 0; lane < PASS_BLOCK_SIZE; lane += 16) {
+		const __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chars + lane));
+		const __m128i back_or_right = _mm_or_si128(_mm_cmpeq_epi8(lanes, back_row), _mm_cmpeq_epi8(lanes, right_col));
+		block |= static_cast<uint64_t>(static_cast<unsigned int>(_mm_movemask_epi8(back_or_right))) << lane;
+	}
+#else
+	for (size_t i = 0; i < PASS_BLOCK_SIZE; ++i) {
+		block |= static_cast<uint64_t>(chars[i] == PASS_BACK_ROW_CHAR || chars[i] == PASS_RIGHT_COL_CHAR) << i;
+	}
+#endif
+	return block;
+}
+
+// Running summary of every seat id seen, so the manifest never needs to be stored
+class seat_summary {
+public:
+	void add_seat(unsigned int id);
+	unsigned int get_missing_seat() const;
+
+	unsigned int m_highest_id = 0;
+	unsigned int m_lowest_id = ~0u;
+	unsigned int m_id_xor = 0;
+	size_t m_num_seats = 0;
+};
+
+// Add a seat to the summary
+//
+// id:	The seat id
+void seat_summary::add_seat(unsigned int id)
+{
+	m_highest_id = id > m_highest_id ? id : m_highest_id;
+	m_lowest_id = id < m_lowest_id ? id : m_lowest_id;
+	m_id_xor ^= id;
+	++m_num_seats;
+}
+
+// Get the single missing seat between the lowest and highest seat
+// Every present seat cancels itself out of the XOR of the full range, leaving only the missing one
+//
+// Returns the missing seat id
+unsigned int seat_summary::get_missing_seat() const
+{
+	if (m_num_seats == 0) {
+		return 0;
+	}
+	const unsigned int range_xor = xor_up_to(m_highest_id) ^ (m_lowest_id == 0 ? 0 : xor_up_to(m_lowest_id - 1));
+	return range_xor ^ m_id_xor;
+}
+
+// Decode every pass in the manifest in one streaming pass, using a fixed size buffer
+//
+// input:	The manifest with one pass per line
+//
+// Returns the summary of all the seats
+static seat_summary decode_manifest(std::ifstream& input)
+{
+	seat_summary seats;
+	std::vector<char> buffer(MANIFEST_CHUNK_SIZE + MANIFEST_CHUNK_PADDING, '\0');
+	size_t carried = 0;
+	const unsigned int pass_mask = (1u << PASS_NUM_DIGS) - 1;
+
+	while (input) {
+		input.read(buffer.data() + carried, MANIFEST_CHUNK_SIZE - carried);
+		const size_t size = carried + static_cast<size_t>(input.gcount());
+		const bool last_chunk = !input;
+		std::fill(buffer.begin() + size, buffer.begin() + size + MANIFEST_CHUNK_PADDING, '\0');
+
+		size_t pos = 0;
+		size_t block_start = 0;
+		uint64_t block = classify_pass_block(buffer.data());
+		while (true) {
+			// Skip the line endings between passes
+			while (pos < size && (buffer[pos] == '\n' || buffer[pos] == '\r')) {
+				++pos;
+			}
+			if (size - pos < PASS_NUM_DIGS) {
+				break;
+			}
+			// Passes are cut out of the classified block until one runs past its end
+			if (pos + PASS_NUM_DIGS > block_start + PASS_BLOCK_SIZE) {
+				block_start = pos;
+				block = classify_pass_block(buffer.data() + pos);
+			}
+			seats.add_seat(reverse_pass_bits(static_cast<unsigned int>(block >> (pos - block_start)) & pass_mask));
+			pos += PASS_NUM_DIGS;
+		}
+
+		// Move a partial pass to the front to be finished by the next chunk
+		carried = last_chunk ? 0 : size - pos;
+		std::copy(buffer.begin() + pos, buffer.begin() + size, buffer.begin());
+	}
+	return seats;
+}
 
 /*
-* This airline uses binary space partitioning to seat people. 
+* This airline uses binary space partitioning to seat people.
 * A seat might be specified like FBFBBFFRLR, where F means "front", B means "back", L means "left", and R means "right".
 * Every seat also has a unique seat ID: multiply the row by 8, then add the column
 */
@@ -21,35 +173,16 @@ static constexpr char PASS_RIGHT_COL_CHAR = 'R';
 // What is the highest seat ID on a boarding pass?
 void problem_1::solve(const std::string& file_name)
 {
-	std::ifstream input(file_name);
+	std::ifstream input(file_name, std::ios::binary);
 
 	if (!input.is_open()) {
 		return;
 	}
 
-	unsigned int highest_id = 0;
-	while (!input.eof()) {
-		std::string boarding_pass;
-		std::getline(input, boarding_pass);
-
-		unsigned int id = 0;
-		unsigned int mask = 1 << (PASS_NUM_DIGS - 1);
-		
-		// Create the binary representation for the ticket
-		for (int i = 0; i < PASS_NUM_DIGS; ++i) {
-			if ((i < PASS_NUM_ROW_DIGS && boarding_pass[i] == PASS_BACK_ROW_CHAR) || (i >= PASS_NUM_ROW_DIGS && boarding_pass[i] == PASS_RIGHT_COL_CHAR)) {
-				id |= mask;
-			}
-			mask = mask >> 1;
-		}
-		// Save the highest
-		if (id > highest_id) {
-			highest_id = id;
-		}
-	}
+	const seat_summary seats = decode_manifest(input);
 	input.close();
 
-	output_answer(std::to_string(highest_id));
+	output_answer(std::to_string(seats.m_highest_id));
 }
 
 /*
@@ -60,44 +193,14 @@ void problem_1::solve(const std::string& file_name)
 // What is the ID of your seat
 void problem_2::solve(const std::string& file_name)
 {
-	std::ifstream input(file_name);
+	std::ifstream input(file_name, std::ios::binary);
 
 	if (!input.is_open()) {
 		return;
 	}
 
-	unsigned int highest_id = 0;
-	unsigned int lowest_id = 1024;
-	unsigned int total_id = 0;
-	while (!input.eof()) {
-		std::string boarding_pass;
-		std::getline(input, boarding_pass);
-
-		unsigned int id = 0;
-		unsigned int mask = 1 << (PASS_NUM_DIGS - 1);
-		// Create the binary representation for the ticket
-		for (int i = 0; i < PASS_NUM_DIGS; ++i) {
-			if ((i < PASS_NUM_ROW_DIGS && boarding_pass[i] == PASS_BACK_ROW_CHAR) || (i >= PASS_NUM_ROW_DIGS && boarding_pass[i] == PASS_RIGHT_COL_CHAR)) {
-				id |= mask;
-			}
-			mask = mask >> 1;
-		}
-		// Save the highest, lowest and total ids
-		if (id > highest_id) {
-			highest_id = id;
-		} 
-		if (id < lowest_id) {
-			lowest_id = id;
-		}
-		total_id += id;
-	}
+	const seat_summary seats = decode_manifest(input);
 	input.close();
 
-	// Compute what the summation from the lowest to highest id should be
-	unsigned int theoretical_total = static_cast<unsigned int>((lowest_id + highest_id) * ((highest_id - lowest_id + 1) / 2.f));
-
-	// The difference is the missing id
-	unsigned int missing_id = theoretical_total - total_id;
-
-	output_answer(std::to_string(missing_id));
+	output_answer(std::to_string(seats.get_missing_seat()));
 }
\ No newline at end of file
@@ -1,122 +1,109 @@
 #include "day_6.h"
 
 #include "../common_includes.h"
+#include "../bit_utils.h"
 
-#include <algorithm>
+#include <cstdint>
+#include <vector>
 
 PROBLEM_CLASS_CPP(6);
 
-static constexpr int QUESTIONS_MAX = 26;
 static constexpr char QUESTION_MIN = 'a';
-static constexpr int question_char_to_index(const char question_char) { return static_cast<int>(question_char - QUESTION_MIN); }
+static constexpr char QUESTION_MAX = 'z';
+static constexpr uint32_t ALL_QUESTIONS_MASK = (1u << (QUESTION_MAX - QUESTION_MIN + 1)) - 1;
 
-// Class to hold an individual's answers to the form
-class customs_individual {
-public:
-	customs_individual(const std::string& input);
+// Bytes read from the survey at a time
+static constexpr size_t SURVEY_CHUNK_SIZE = 1 << 16;
 
-	bool m_answers[QUESTIONS_MAX] = { false };
-};
+// Get the bit for an answer, or 0 if the character isn't an answer
+//
+// question_char:	The character from the form
+//
+// Returns the answer's bit
+static constexpr uint32_t question_char_to_bit(const char question_char)
+{
+	return (question_char >= QUESTION_MIN && question_char <= QUESTION_MAX) ? 1u << (question_char - QUESTION_MIN) : 0u;
+}
 
-// Class to hold the answers a whole group has
-class customs_group {
+// Running totals for both questions, filled in from a single pass over the survey
+// Each person and group is a mask with a bit per question
+class customs_totals {
 public:
-	customs_group(std::ifstream& input);
-	int get_num_answers_present();
-	int get_num_all_answers_present();
+	customs_totals(std::ifstream& input);
 
-	bool m_answer_present[QUESTIONS_MAX] = { false };
-	bool m_answers_all_present[QUESTIONS_MAX] = { false };
+	int m_num_answers_present = 0;
+	int m_num_all_answers_present = 0;
 
-	void add_individual_answers(const customs_individual& ind);
-	void init_all_answers(const customs_individual& ind);
-};
+private:
+	void add_chunk(const char* chunk, size_t size);
+	void end_individual();
+	void end_group();
 
-// Create an individual's customs from input
-//
-// input:	Character array of answered questions
-customs_individual::customs_individual(const std::string& input)
-{
-	for (const char answer : input) {
-		m_answers[question_char_to_index(answer)] = true;
-	}
-}
+	uint32_t m_individual_answers = 0;
+	uint32_t m_group_answer_present = 0;
+	uint32_t m_group_answers_all_present = ALL_QUESTIONS_MASK;
+	bool m_group_empty = true;
+};
 
-// Create a group's customs from input
+// Read every group's customs from input
 //
-// input:	Individual customs seperated by new lines
-customs_group::customs_group(std::ifstream& input)
+// input:	Individual customs seperated by new lines, groups seperated by empty lines
+customs_totals::customs_totals(std::ifstream& input)
 {
-	bool inited = false;
-	while (!input.eof()) {
-		std::string customs_ind;
-		std::getline(input, customs_ind);
-		if (customs_ind.empty()) {
-			return;
-		}
-
-		customs_individual ind(customs_ind);
-		// We start by setting the answers to false
-		// and the first individual will set their answers to true
-		// Then future individuals will set ones they don't have as false
-		if (!inited) {
-			init_all_answers(ind);
-			inited = true;
-		}
-		add_individual_answers(ind);		
+	std::vector<char> buffer(SURVEY_CHUNK_SIZE);
+	while (input) {
+		input.read(buffer.data(), buffer.size());
+		add_chunk(buffer.data(), static_cast<size_t>(input.gcount()));
 	}
-}
 
-// Add the individual's answer's to the group's
-//
-// ind:	The individual to add
-void customs_group::add_individual_answers(const customs_individual& ind)
-{
-	for (int i = 0; i < QUESTIONS_MAX; ++i) {
-		// If it's present, then make sure we mark that at least one person has it
-		if (ind.m_answers[i]) {
-			m_answer_present[i] = true;
-		} else {
-			// Mark they don't all have
-			m_answers_all_present[i] = false;
-		}
-	}
+	// The last line and group may not have been terminated
+	end_individual();
+	end_group();
 }
 
-// Init all the answers
+// Add the answers from part of the survey
 //
-// ind:	The individual to set intial answers that are present
-void customs_group::init_all_answers(const customs_individual& ind)
+// chunk:	The survey characters
+// size:	Number of characters in the chunk
+void customs_totals::add_chunk(const char* chunk, size_t size)
 {
-	for (int i = 0; i < QUESTIONS_MAX; ++i) {
-		if (ind.m_answers[i]) {
-			m_answers_all_present[i] = true;
+	for (size_t i = 0; i < size; ++i) {
+		const char answer = chunk[i];
+		if (answer == '\n') {
+			// An empty line ends the group
+			if (m_individual_answers == 0) {
+				end_group();
+			} else {
+				end_individual();
+			}
+			continue;
 		}
+		m_individual_answers |= question_char_to_bit(answer);
 	}
 }
 
-// Get the number of answers that any member has answered
-//
-// Returns number of answers
-int customs_group::get_num_answers_present()
+// Add the current individual's answers to their group
+void customs_totals::end_individual()
 {
-	int present = 0;
-	for (bool answer : m_answer_present) {
-		if (answer) ++present;
+	if (m_individual_answers == 0) {
+		return;
 	}
-	return present;
+	m_group_answer_present |= m_individual_answers;
+	m_group_answers_all_present &= m_individual_answers;
+	m_individual_answers = 0;
+	m_group_empty = false;
 }
 
-// Get the number of answers all members have answered
-//
-// Returns number of answers
-int customs_group::get_num_all_answers_present()
+// Add the current group's answers to the totals
+void customs_totals::end_group()
 {
-	int present = 0;
-	for (bool answer : m_answers_all_present) {
-		if (answer) ++present;
+	if (!m_group_empty) {
+		m_num_answers_present += popcount_32(m_group_answer_present);
+		m_num_all_answers_present += popcount_32(m_group_answers_all_present);
 	}
-	return present;
+	m_group_answer_present = 0;
+	m_group_answers_all_present = ALL_QUESTIONS_MASK;
+	m_group_empty = true;
 }
 
 /*
@@ -128,21 +115,17 @@ int customs_group::get_num_all_answers_present()
 // For each group, count the number of questions to which anyone answered "yes"
 void problem_1::solve(const std::string& file_name)
 {
-	std::ifstream input(file_name);
+	std::ifstream input(file_name, std::ios::binary);
 
 	if (!input.is_open()) {
 		return;
 	}
 
-	int present_answers = 0;
-	while (!input.eof()) {
-		customs_group group(input);
-		present_answers += group.get_num_answers_present();
-	}
+	const customs_totals totals(input);
 	input.close();
 
 	std::string answer;
-	answer = std::to_string(present_answers);
+	answer = std::to_string(totals.m_num_answers_present);
 	output_answer(answer);
 }
 
@@ -154,21 +137,16 @@ void problem_1::solve(const std::string& file_name)
 // For each group, count the number of questions to which everyone answered "yes"
 void problem_2::solve(const std::string& file_name)
 {
-	std::ifstream input(file_name);
+	std::ifstream input(file_name, std::ios::binary);
 
 	if (!input.is_open()) {
 		return;
 	}
 
-	int present_answers = 0;
-	while (!input.eof()) {
-		customs_group group(input);
-		present_answers += group.get_num_all_answers_present();
-	}
-
+	const customs_totals totals(input);
 	input.close();
 
 	std::string answer;
-	answer = std::to_string(present_answers);
+	answer = std::to_string(totals.m_num_all_answers_present);
 	output_answer(answer);
 }
\ No newline at end of file
@@ -1,165 +1,240 @@
 #include "day_7.h"
 
 #include "../common_includes.h"
+#include "../string_interner.h"
 
+#include <cstring>
+#include <iterator>
 #include <vector>
-#include <map>
-#include <algorithm>
 
 PROBLEM_CLASS_CPP(7);
 
-typedef int bag_type;
+typedef string_interner::id bag_type;
 
-static const char* const BAG = "bag";
-static const char* const SHINY_GOLD = "shinygold";
-static const bag_type SHINY_GOLD_TYPE = 0;
+static const char* const SHINY_GOLD = "shiny gold";
+static constexpr bag_type INVALID_BAG_TYPE = string_interner::INVALID_ID;
+// A bag that can reach a cycle, or holds too many bags to count
+static constexpr unsigned long long BAGS_UNBOUNDED = ~0ull;
 
-static bag_type Current_bag_type = 1;
-static std::map<std::string, bag_type> Bag_types;
+// The bag rules compiled into a compressed sparse row graph of what each bag holds, and the reverse graph of what holds each bag
+// The total bags inside every bag are computed once when compiled so any bag can be queried
+class bag_rules {
+public:
+	bag_rules(std::ifstream& input);
 
-// Get the next bag name from the input line
-//
-// bag_name:		(Output) The name of the bag
-// input_stream:	The input line of the bag and possibly other bags
-//
-// Returns true if a name was found
-static bool get_bag_name(std::string* bag_name, std::istream* input_stream)
-{
-	std::getline(*input_stream, *bag_name, ' ');
-	std::string next_word;
+	bag_type get_bag_type(const std::string& bag_name) const;
+	int get_num_bag_types() const { return static_cast<int>(m_bag_names.size()); }
+	std::string get_bag_name(bag_type type) const { return m_bag_names.get_string(type); }
 
-	while (!input_stream->eof())
-	{
-		std::getline(*input_stream, next_word, ' ');
+	std::vector<bag_type> get_containers(bag_type inner_type) const;
+	unsigned long long get_total_bags_inside(bag_type outer_type) const { return m_total_bags_inside[outer_type]; }
 
-		// If this word is "bag", "bag,", "bag.", or "bags" then we've found the name
-		if (next_word.find(BAG) == 0 && next_word.size() <= 5) {
-			if (next_word.size() == 3 || (next_word.size() == 4 && next_word.back() == 's') || (next_word.back() == ',' || next_word.back() == '.')) {
-				return true;
-			}
+private:
+	// A single "outer contains count inner" rule before being compiled
+	struct bag_rule {
+		bag_type m_outer;
+		bag_type m_inner;
+		int m_count;
+	};
+
+	void parse_rule_line(const char* line_begin, const char* line_end, std::vector<bag_rule>* rules);
+	void compile(const std::vector<bag_rule>& rules);
+	void compute_total_bags_inside();
+
+	string_interner m_bag_names;
+
+	// Bags held by bag i are m_inside_types[m_inside_offsets[i]..m_inside_offsets[i + 1]] with the matching m_inside_counts
+	std::vector<int> m_inside_offsets;
+	std::vector<bag_type> m_inside_types;
+	std::vector<int> m_inside_counts;
+
+	// Bags that directly hold bag i are m_holder_types[m_holder_offsets[i]..m_holder_offsets[i + 1]]
+	std::vector<int> m_holder_offsets;
+	std::vector<bag_type> m_holder_types;
+
+	std::vector<unsigned long long> m_total_bags_inside;
+};
+
+// Compile the bag rules from input
+//
+// input:	A rule per line for what each bag color holds
+bag_rules::bag_rules(std::ifstream& input)
+{
+	const std::string rules_text((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+	std::vector<bag_rule> rules;
+	const char* line_begin = rules_text.data();
+	const char* const text_end = line_begin + rules_text.size();
+	while (line_begin < text_end) {
+		const char* line_end = static_cast<const char*>(std::memchr(line_begin, '\n', text_end - line_begin));
+		if (line_end == nullptr) {
+			line_end = text_end;
 		}
-		// Otherwise this word is a part of the name
-		bag_name->append(next_word);
+		parse_rule_line(line_begin, line_end, &rules);
+		line_begin = line_end + 1;
 	}
-	return false;
+
+	compile(rules);
+	compute_total_bags_inside();
 }
 
 // Get bag type for name
 //
-// bag_name:	The uniqueu name of a bag type
+// bag_name:	The unique name of a bag type
 //
-// Returns the bag type
-static bag_type get_bag_type(const std::string& bag_name)
+// Returns the bag type, or INVALID_BAG_TYPE if no rule mentions it
+bag_type bag_rules::get_bag_type(const std::string& bag_name) const
 {
-	auto bag_type_iter = Bag_types.find(bag_name);
-	if (bag_type_iter == Bag_types.end()) {
-		Bag_types.emplace(bag_name, Current_bag_type);
-		return Current_bag_type++;
-	}
-	return bag_type_iter->second;
+	return m_bag_names.find(bag_name);
 }
 
-// Bag class that lists what types and how many are inside it
-// and whether it can have gold
-class bag {
-public:
-	enum class can_have_gold {
-		YES,
-		NO,
-		UNKNOWN,
-	};
-
-	bag(const std::string& input_line);
-
-	bag_type m_type;
-	can_have_gold m_has_gold;
-	std::vector<std::pair<bag_type, int>> m_bag_types_inside;
-};
-
-// Create a bag from input
-bag::bag(const std::string& input_line)
+// Parse the rules from one line, such as "light red bags contain 1 bright white bag, 2 muted yellow bags."
+//
+// line_begin:	The first character of the line
+// line_end:	One past the last character of the line
+// rules:		(Output) The rules to add to
+void bag_rules::parse_rule_line(const char* line_begin, const char* line_end, std::vector<bag_rule>* rules)
 {
-	m_has_gold = can_have_gold::UNKNOWN;
-
-	std::istringstream input_stream(input_line);
+	word_tokenizer tokenizer(line_begin, line_end);
+	const char* word;
+	size_t length;
 
 	// Get this bag
-	std::string bag_name;
-	get_bag_name(&bag_name, &input_stream);
-
-	m_type = get_bag_type(bag_name);
+	if (!tokenizer.next_words(2, &word, &length)) {
+		return;
+	}
+	const bag_type outer_type = m_bag_names.intern(word, length);
 
-	// Get to the next bag
-	input_stream.ignore(32, ' ');
+	// Skip "bags contain"
+	tokenizer.next_words(2, &word, &length);
 
-	// Get all the bags that can go within this one
-	while (!input_stream.eof()) {
+	// Get all the bags that can go within this one, "no other bags." will fail to parse a count
+	while (tokenizer.next_word(&word, &length)) {
 		int num_bags = 0;
-		input_stream >> num_bags;
-		if (input_stream.fail()) {
+		for (size_t i = 0; i < length && word[i] >= '0' && word[i] <= '9'; ++i) {
+			num_bags = num_bags * 10 + (word[i] - '0');
+		}
+		if (num_bags == 0) {
 			return;
 		}
-		input_stream.ignore();
 
 		// Get bag within's name and type
-		get_bag_name(&bag_name, &input_stream);
-		bag_type type = get_bag_type(bag_name);
+		if (!tokenizer.next_words(2, &word, &length)) {
+			return;
+		}
+		const bag_type inner_type = m_bag_names.intern(word, length);
 
 		// Add the type and how many this can hold
-		m_bag_types_inside.emplace_back(type, num_bags);
+		rules->push_back({ outer_type, inner_type, num_bags });
 
-		if (input_stream.peek() == ' ') {
-			input_stream.ignore();
-		}
+		// Skip "bag," "bags," or "bags."
+		tokenizer.next_word(&word, &length);
 	}
 }
 
-// Comparotor to make the gold bag be sorted first
-bool bag_lt(const bag& lhs, const bag& rhs) 
+// Build the forward and reverse graphs by counting each bag's edges then placing them
+//
+// rules:	Every rule that was parsed
+void bag_rules::compile(const std::vector<bag_rule>& rules)
 {
-	return lhs.m_type < rhs.m_type;
+	const size_t num_types = m_bag_names.size();
+	m_inside_offsets.assign(num_types + 1, 0);
+	m_holder_offsets.assign(num_types + 1, 0);
+	for (const bag_rule& rule : rules) {
+		++m_inside_offsets[rule.m_outer + 1];
+		++m_holder_offsets[rule.m_inner + 1];
+	}
+	for (size_t i = 0; i < num_types; ++i) {
+		m_inside_offsets[i + 1] += m_inside_offsets[i];
+		m_holder_offsets[i + 1] += m_holder_offsets[i];
+	}
+
+	m_inside_types.resize(rules.size());
+	m_inside_counts.resize(rules.size());
+	m_holder_types.resize(rules.size());
+	std::vector<int> next_inside(m_inside_offsets.begin(), m_inside_offsets.end() - 1);
+	std::vector<int> next_holder(m_holder_offsets.begin(), m_holder_offsets.end() - 1);
+	for (const bag_rule& rule : rules) {
+		const int inside_index = next_inside[rule.m_outer]++;
+		m_inside_types[inside_index] = rule.m_inner;
+		m_inside_counts[inside_index] = rule.m_count;
+		m_holder_types[next_holder[rule.m_inner]++] = rule.m_outer;
+	}
 }
 
-// Determine if the bag can contain a shiny gold bag
-// 
-// cur_bag:	The bag to check if it can have gold
-// bags:		The available bags and their types
-//
-// Returns true if the bag can hold a shiny gold bag
-bool can_bag_have_gold(bag& cur_bag, std::vector<bag>& bags)
+// Compute the total bags inside every bag, starting from the bags that hold nothing
+// and only visiting a bag once everything it holds is known
+// Bags that can reach a cycle can never be resolved and are left unbounded, as are bags whose total would overflow
+void bag_rules::compute_total_bags_inside()
 {
-	// Already cached
-	if (cur_bag.m_has_gold != bag::can_have_gold::UNKNOWN) {
-		return cur_bag.m_has_gold == bag::can_have_gold::YES;
+	const int num_types = get_num_bag_types();
+	m_total_bags_inside.assign(num_types, BAGS_UNBOUNDED);
+
+	std::vector<int> unresolved_inside(num_types);
+	std::vector<bag_type> ready;
+	ready.reserve(num_types);
+	for (bag_type type = 0; type < num_types; ++type) {
+		unresolved_inside[type] = m_inside_offsets[type + 1] - m_inside_offsets[type];
+		if (unresolved_inside[type] == 0) {
+			ready.push_back(type);
+		}
 	}
 
-	// Check each bag that this bag can contain
-	for (std::pair<bag_type, int> bag_inside_type_pair : cur_bag.m_bag_types_inside) {
-		bag& bag_inside = bags[bag_inside_type_pair.first];
-		// If the bag inside is gold or can have gold, cache and return true
-		if (bag_inside.m_type == SHINY_GOLD_TYPE || can_bag_have_gold(bag_inside, bags)) {
-			cur_bag.m_has_gold = bag::can_have_gold::YES;
-			return true;
+	for (size_t ready_index = 0; ready_index < ready.size(); ++ready_index) {
+		const bag_type type = ready[ready_index];
+
+		unsigned long long bags_inside = 0;
+		for (int i = m_inside_offsets[type]; i < m_inside_offsets[type + 1]; ++i) {
+			const unsigned long long count = static_cast<unsigned long long>(m_inside_counts[i]);
+			const unsigned long long inner_total = m_total_bags_inside[m_inside_types[i]];
+			// Keep the total below BAGS_UNBOUNDED so it can't be mistaken for it
+			if (inner_total == BAGS_UNBOUNDED || (count != 0 && inner_total + 1 > (BAGS_UNBOUNDED - 1 - bags_inside) / count)) {
+				bags_inside = BAGS_UNBOUNDED;
+				break;
+			}
+			bags_inside += count * (inner_total + 1);
 		}
-	}
+		m_total_bags_inside[type] = bags_inside;
 
-	cur_bag.m_has_gold = bag::can_have_gold::NO;
-	return false;
+		// Any holder with all its bags resolved can now be computed
+		for (int i = m_holder_offsets[type]; i < m_holder_offsets[type + 1]; ++i) {
+			if (--unresolved_inside[m_holder_types[i]] == 0) {
+				ready.push_back(m_holder_types[i]);
+			}
+		}
+	}
 }
 
-// Get total bags inside given bag
+// Get every bag that can eventually contain the given bag
+//
+// inner_type:	The bag to be contained
 //
-// cur_bag:	The bag to count contained bags
-// bags:		The available bags and their types
-int get_total_bags_inside(const bag& cur_bag, std::vector<bag>& bags)
+// Returns the types of the bags that can hold it
+std::vector<bag_type> bag_rules::get_containers(bag_type inner_type) const
 {
-	int bags_inside = 0;
-	for (std::pair<bag_type, int> bag_inside_type_pair : cur_bag.m_bag_types_inside) {
-		bag& bag_inside = bags[bag_inside_type_pair.first];
-		bags_inside += bag_inside_type_pair.second * (get_total_bags_inside(bag_inside, bags) + 1);
+	std::vector<bag_type> containers;
+	if (inner_type == INVALID_BAG_TYPE) {
+		return containers;
 	}
 
-	return bags_inside;
+	std::vector<bool> visited(m_bag_names.size(), false);
+	visited[inner_type] = true;
+
+	// Walk the reverse graph outwards from the bag
+	std::vector<bag_type> to_visit(1, inner_type);
+	while (!to_visit.empty()) {
+		const bag_type type = to_visit.back();
+		to_visit.pop_back();
+		for (int i = m_holder_offsets[type]; i < m_holder_offsets[type + 1]; ++i) {
+			const bag_type holder = m_holder_types[i];
+			if (!visited[holder]) {
+				visited[holder] = true;
+				containers.push_back(holder);
+				to_visit.push_back(holder);
+			}
+		}
+	}
+	return containers;
 }
 
 /*
@@ -177,24 +252,10 @@ void problem_1::solve(const std::string& file_name)
 		return;
 	}
 
-	Bag_types.emplace(SHINY_GOLD, SHINY_GOLD_TYPE);
-	std::vector<bag> bags;
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		bags.emplace_back(input_line);
-	}
+	const bag_rules rules(input);
 	input.close();
-	
-	// Sort the bags by their bag type to make the gold bag first
-	std::sort(bags.begin(), bags.end(), bag_lt);
-
-	int bags_have_gold = 0;
-	for (bag& cur_bag : bags) {
-		if (can_bag_have_gold(cur_bag, bags)) {
-			++bags_have_gold;
-		}
-	}
+
+	const size_t bags_have_gold = rules.get_containers(rules.get_bag_type(SHINY_GOLD)).size();
 
 	std::string answer;
 	answer = std::to_string(bags_have_gold);
@@ -210,19 +271,18 @@ void problem_2::solve(const std::string& file_name)
 		return;
 	}
 
-	Bag_types.emplace(SHINY_GOLD, SHINY_GOLD_TYPE);
-	std::vector<bag> bags;
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		bags.emplace_back(input_line);
-	}
+	const bag_rules rules(input);
 	input.close();
 
-	// Sort the bags by their bag type to make the gold bag first
-	std::sort(bags.begin(), bags.end(), bag_lt);
+	const bag_type gold_type = rules.get_bag_type(SHINY_GOLD);
+	if (gold_type == INVALID_BAG_TYPE) {
+		return;
+	}
 
-	int bags_inside = get_total_bags_inside(bags[SHINY_GOLD_TYPE], bags);
+	const unsigned long long bags_inside = rules.get_total_bags_inside(gold_type);
+	if (bags_inside == BAGS_UNBOUNDED) {
+		return;
+	}
 
 	std::string answer;
 	answer = std::to_string(bags_inside);
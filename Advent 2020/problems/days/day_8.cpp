@@ -2,177 +2,348 @@
 
 #include "../common_includes.h"
 
-#include <map>
-#include <stack>
-#include <limits>
-
-#undef max
+#include <cstdint>
+#include <vector>
 
 PROBLEM_CLASS_CPP(8);
 
-typedef void (*instruction_sig)(int, std::ifstream&, bool);
-
-static constexpr int MAX_LINES = 999;
 static constexpr char PLUS = '+';
 static const char* const INST_ACC = "acc";
 static const char* const INST_JMP = "jmp";
 static const char* const INST_NOP = "nop";
+static constexpr int NO_FLIP = -1;
+// Set to write a trace of each run next to the input file, named after the part so they don't overwrite each other
+static constexpr bool TRACE_EXECUTION = false;
+static const char* const TRACE_FILE_SUFFIX = ".trace.csv";
+
+// Operations the console understands
+enum class opcode : uint8_t {
+	ACC,
+	JMP,
+	NOP,
+};
 
-static int Accumulator;
-static int Current_line;
-static bool Visited_lines[MAX_LINES] = { false };
-static int Line_flipped;
+// A decoded instruction
+struct instruction {
+	int32_t m_arg;
+	opcode m_op;
+};
 
-static std::map<int, instruction_sig> instructions;
+// Why the program stopped running
+enum class exit_reason {
+	TERMINATED,		// Ran the instruction after the last one
+	LOOPED,			// Was about to run an instruction a second time
+	OUT_OF_BOUNDS,	// Jumped somewhere outside of the program
+};
 
-// Convert the command code to crc
-static int code_to_crc(const char code[4])
-{
-	int crc = 0;
-	for (int i = 0; i < 4; ++i) crc += static_cast<int>(code[i]);
-	return crc;
-}
+// The state when the program stopped
+struct run_result {
+	exit_reason m_reason;
+	long long m_accumulator;
+	// The instruction that would have run next, for a loop this is where the loop is entered again
+	int m_next_line;
+};
 
-// Convert the command code to crc
-static int code_to_crc(const std::string& code)
-{
-	int crc = 0;
-	for (const char c : code) crc += static_cast<int>(c);
-	return crc;
-}
+// The line to flip to make the program terminate
+struct repair_result {
+	bool m_found;
+	// NO_FLIP if the program already terminates
+	int m_flipped_line;
+	long long m_accumulator;
+};
 
-static const int INST_ACC_CRC = code_to_crc(INST_ACC);
-static const int INST_JMP_CRC = code_to_crc(INST_JMP);
-static const int INST_NOP_CRC = code_to_crc(INST_NOP);
+// Tracer that records nothing, every call compiles away
+class no_trace {
+public:
+	void on_execute(int) {}
+	void on_jump(int) {}
+	void on_stop(const run_result&) {}
+};
 
-// Frame to record the current state
-struct frame {
-	frame(int acc, int line, std::streampos pos) : m_acc(acc), m_line(line), m_pos(pos) { };
-	int m_acc;
-	int m_line;
-	std::streampos m_pos;
+// Tracer that records how a run went into buffers allocated up front
+class execution_trace {
+public:
+	execution_trace(int num_lines);
+
+	void on_execute(int line);
+	void on_jump(int line) { ++m_jumps_taken[line]; };
+	void on_stop(const run_result& result) { m_result = result; };
+
+	// Each line can only run once before the run stops, so these are only ever 0 or 1 and just repeat the path per line
+	std::vector<unsigned int> m_hits;
+	std::vector<unsigned int> m_jumps_taken;
+	// The path can never be longer than the program for the same reason
+	std::vector<int> m_path;
+	size_t m_path_length = 0;
+	run_result m_result = { exit_reason::TERMINATED, 0, 0 };
 };
 
-// Frame stack to record the states of the program
-static std::stack<frame> Frame_stack;
+// The handheld game console with its boot code decoded once into memory
+class handheld_console {
+public:
+	handheld_console(std::ifstream& input);
 
-// Go to the next line of the input stream
-static void inline next_line(std::ifstream& input)
-{
-	input.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-	++Current_line;
-}
+	run_result run(int flipped_line = NO_FLIP) const;
+	template<typename tracer>
+	run_result run(int flipped_line, tracer& trace) const;
+	bool write_trace(const execution_trace& trace, const std::string& file_name) const;
+	repair_result find_repair() const;
+	int get_num_lines() const { return static_cast<int>(m_program.size()); }
+
+private:
+	static bool decode_line(const std::string& line, instruction* decoded);
 
-// Go to the previous line in the input
-static void inline prev_line(std::ifstream& input)
+	int get_next_line(int line, bool flipped) const;
+	std::vector<bool> get_terminating_lines() const;
+
+	std::vector<instruction> m_program;
+};
+
+// Decode the boot code
+//
+// input:	One instruction per line
+handheld_console::handheld_console(std::ifstream& input)
 {
-	input.seekg(-3,std::ios_base::cur); //\n and last char
-	while (input.peek() != '\n') {
-		input.seekg(-1, std::ios_base::cur);
+	std::string line;
+	while (std::getline(input, line)) {
+		instruction decoded;
+		if (decode_line(line, &decoded)) {
+			m_program.push_back(decoded);
+		}
 	}
-	input.ignore();
-	--Current_line;
 }
 
-// Perform the accumulate operation
-// 
-// arg:		Amount to add to accumulator
-// input:	Remaining input 
-// flip:		Unused
-static void acc(int arg, std::ifstream& input, bool flip)
+// Decode a single line such as "jmp -4"
+//
+// line:	The line to decode
+// decoded:	(Output) The decoded instruction
+//
+// Returns true if the line held an instruction
+bool handheld_console::decode_line(const std::string& line, instruction* decoded)
 {
-	if (flip) {
-		Accumulator -= arg;
+	if (line.size() < 6) {
+		return false;
+	}
+
+	if (line.compare(0, 3, INST_ACC) == 0) {
+		decoded->m_op = opcode::ACC;
+	} else if (line.compare(0, 3, INST_JMP) == 0) {
+		decoded->m_op = opcode::JMP;
+	} else if (line.compare(0, 3, INST_NOP) == 0) {
+		decoded->m_op = opcode::NOP;
 	} else {
-		Accumulator += arg;
+		return false;
+	}
+
+	int32_t arg = 0;
+	for (size_t i = 5; i < line.size() && line[i] >= '0' && line[i] <= '9'; ++i) {
+		arg = arg * 10 + (line[i] - '0');
 	}
-	next_line(input);
+	decoded->m_arg = line[4] == PLUS ? arg : -arg;
+	return true;
 }
 
-static void nop(int arg, std::ifstream& input, bool flip);
-// Perform the jump operation to jump to the specified line
+// Create an empty trace for a program
 //
-// arg:		The amount of lines to jump
-// input:	Remaining input
-// flip:		If we should flip this to a nop
-static void jmp(int arg, std::ifstream& input, bool flip)
+// num_lines:	Number of lines in the program
+execution_trace::execution_trace(int num_lines) : m_hits(num_lines, 0), m_jumps_taken(num_lines, 0), m_path(num_lines, 0)
 {
-	if (flip) {
-		nop(arg, input, false);
-	} else {
-		if (arg >= 0) {
-			for (int i = 0; i < arg; ++i) {
-				next_line(input);
-			}
-		} else {
-			for (int i = 0; i > arg; --i) {
-				prev_line(input);
-			}
-		}
-	}
 }
 
-// Perform the nop operation
+// Record a line being run
 //
-// arg:		Used only if we flip
-// input:	Remaining input
-// flip:		Whether to flip this to a jump perform
-static void nop(int arg, std::ifstream& input, bool flip)
+// line:	The line being run
+void execution_trace::on_execute(int line)
 {
-	if (flip) {
-		jmp(arg, input, false);
-	} else {
-		next_line(input);
+	++m_hits[line];
+	m_path[m_path_length++] = line;
+}
+
+// Run the program until it terminates, loops, or jumps out of bounds
+//
+// flipped_line:	Line to run with jmp and nop swapped, or NO_FLIP
+//
+// Returns the state the program stopped in
+run_result handheld_console::run(int flipped_line) const
+{
+	no_trace trace;
+	return run(flipped_line, trace);
+}
+
+// Run the program until it terminates, loops, or jumps out of bounds
+//
+// flipped_line:	Line to run with jmp and nop swapped, or NO_FLIP
+// trace:			(Output) Tracer told about each line run and jump taken
+//
+// Returns the state the program stopped in
+template<typename tracer>
+run_result handheld_console::run(int flipped_line, tracer& trace) const
+{
+	const int num_lines = get_num_lines();
+	std::vector<uint64_t> visited_lines((num_lines + 63) / 64, 0);
+	const instruction* const program = m_program.data();
+
+	long long accumulator = 0;
+	int line = 0;
+	run_result result;
+	while (true) {
+		if (line == num_lines) {
+			result = { exit_reason::TERMINATED, accumulator, line };
+			break;
+		}
+		if (static_cast<unsigned int>(line) > static_cast<unsigned int>(num_lines)) {
+			result = { exit_reason::OUT_OF_BOUNDS, accumulator, line };
+			break;
+		}
+
+		uint64_t& visited_word = visited_lines[line >> 6];
+		const uint64_t visited_bit = 1ull << (line & 63);
+		if (visited_word & visited_bit) {
+			result = { exit_reason::LOOPED, accumulator, line };
+			break;
+		}
+		visited_word |= visited_bit;
+		trace.on_execute(line);
+
+		const instruction inst = program[line];
+		opcode op = inst.m_op;
+		if (line == flipped_line) {
+			op = op == opcode::JMP ? opcode::NOP : op == opcode::NOP ? opcode::JMP : op;
+		}
+
+		switch (op) {
+		case opcode::ACC:
+			accumulator += inst.m_arg;
+			++line;
+			break;
+		case opcode::JMP:
+			trace.on_jump(line);
+			line += inst.m_arg;
+			break;
+		case opcode::NOP:
+			++line;
+			break;
+		}
 	}
+
+	trace.on_stop(result);
+	return result;
 }
 
-// Get the instruction from the input line
-// inst_crc:	(Output) CRC of the operation
-// arg:			(Output) Arg for the operation
-// input:		Input line to extract from
-static void get_instruction(int* inst_crc, int* arg, std::ifstream& input)
+// Write a trace as CSV, the per line counts first then the path that was run
+//
+// trace:		The trace of a run of this program
+// file_name:	The file to write to
+//
+// Returns true if the file was written
+bool handheld_console::write_trace(const execution_trace& trace, const std::string& file_name) const
 {
-	std::streampos pos = input.tellg();
-	std::string instruction_line;
-	std::getline(input, instruction_line);
-	// We want to keep the input stream where it was
-	input.seekg(pos);
+	static const char* const OP_NAMES[] = { INST_ACC, INST_JMP, INST_NOP };
+	static const char* const EXIT_REASON_NAMES[] = { "terminated", "looped", "out_of_bounds" };
+
+	std::ofstream output(file_name);
+	if (!output.is_open()) {
+		return false;
+	}
 
-	std::string inst = instruction_line.substr(0, 3);
-	bool positive = instruction_line[4] == PLUS;
+	output << "exit_reason,accumulator,next_line\n";
+	output << EXIT_REASON_NAMES[static_cast<int>(trace.m_result.m_reason)] << ',' << trace.m_result.m_accumulator << ',' << trace.m_result.m_next_line << "\n\n";
 
-	*arg = std::stoi(instruction_line.substr(5)) * (positive ? 1 : -1);
-	*inst_crc = code_to_crc(inst);
+	output << "line,op,arg,hits,jumps_taken\n";
+	for (int line = 0; line < get_num_lines(); ++line) {
+		output << line << ',' << OP_NAMES[static_cast<int>(m_program[line].m_op)] << ',' << m_program[line].m_arg << ',' << trace.m_hits[line] << ',' << trace.m_jumps_taken[line] << '\n';
+	}
+
+	output << "\nstep,line\n";
+	for (size_t step = 0; step < trace.m_path_length; ++step) {
+		output << step << ',' << trace.m_path[step] << '\n';
+	}
+	return true;
 }
 
-// Interpret the next line of the input
-// 
-// input:	Input to read and update
-// flip:		Whether the operation should be flipped
-static void interpret_next_line(std::ifstream* input, bool flip)
+// Get the line run after the given one
+//
+// line:	The line being run
+// flipped:	Whether the line has jmp and nop swapped
+//
+// Returns the next line
+int handheld_console::get_next_line(int line, bool flipped) const
 {
-	int inst_crc = 0;
-	int arg = 0;
-	get_instruction(&inst_crc, &arg, *input);
-	instructions[inst_crc](arg, *input, flip);
+	const instruction& inst = m_program[line];
+	const bool jumps = inst.m_op == opcode::JMP ? !flipped : (inst.m_op == opcode::NOP && flipped);
+	return jumps ? line + inst.m_arg : line + 1;
 }
 
-// Init global state
-static void common_setup() 
+// Find every line that will eventually terminate the program if it's reached
+// Each line has a single successor, so this walks the reverse of the control flow graph back from the end of the program
+//
+// Returns a flag for each line and one past the last line, which is where the program terminates
+std::vector<bool> handheld_console::get_terminating_lines() const
 {
-	Accumulator = 0;
+	const int num_lines = get_num_lines();
+
+	// Build the predecessors of each line, ignoring jumps out of bounds
+	std::vector<int> predecessor_offsets(num_lines + 2, 0);
+	for (int line = 0; line < num_lines; ++line) {
+		const int next_line = get_next_line(line, false);
+		if (next_line >= 0 && next_line <= num_lines) {
+			++predecessor_offsets[next_line + 1];
+		}
+	}
+	for (int line = 0; line <= num_lines; ++line) {
+		predecessor_offsets[line + 1] += predecessor_offsets[line];
+	}
+	std::vector<int> predecessors(predecessor_offsets.back());
+	std::vector<int> next_predecessor(predecessor_offsets.begin(), predecessor_offsets.end() - 1);
+	for (int line = 0; line < num_lines; ++line) {
+		const int next_line = get_next_line(line, false);
+		if (next_line >= 0 && next_line <= num_lines) {
+			predecessors[next_predecessor[next_line]++] = line;
+		}
+	}
 
-	instructions.emplace(INST_ACC_CRC, acc);
-	instructions.emplace(INST_JMP_CRC, jmp);
-	instructions.emplace(INST_NOP_CRC, nop);
+	std::vector<bool> terminating(num_lines + 1, false);
+	terminating[num_lines] = true;
+	std::vector<int> to_visit(1, num_lines);
+	while (!to_visit.empty()) {
+		const int line = to_visit.back();
+		to_visit.pop_back();
+		for (int i = predecessor_offsets[line]; i < predecessor_offsets[line + 1]; ++i) {
+			if (!terminating[predecessors[i]]) {
+				terminating[predecessors[i]] = true;
+				to_visit.push_back(predecessors[i]);
+			}
+		}
+	}
+	return terminating;
+}
 
-	Current_line = 0;
-	Line_flipped = -1;
+// Find the single jmp or nop that makes the program terminate when flipped
+// The corrupted line has to be on the original path, so walk it once and flip the first line that lands somewhere that terminates
+//
+// Returns the line to flip and the accumulator when the repaired program terminates
+repair_result handheld_console::find_repair() const
+{
+	const int num_lines = get_num_lines();
+	const std::vector<bool> terminating = get_terminating_lines();
 
-	std::fill(std::begin(Visited_lines), std::end(Visited_lines), false);
-	while (!Frame_stack.empty()) {
-		Frame_stack.pop();
+	if (terminating[0]) {
+		return { true, NO_FLIP, run().m_accumulator };
 	}
+
+	std::vector<bool> visited_lines(num_lines, false);
+	int line = 0;
+	while (line >= 0 && line < num_lines && !visited_lines[line]) {
+		visited_lines[line] = true;
+		if (m_program[line].m_op != opcode::ACC) {
+			const int flipped_next_line = get_next_line(line, true);
+			if (flipped_next_line >= 0 && flipped_next_line <= num_lines && terminating[flipped_next_line]) {
+				return { true, line, run(line).m_accumulator };
+			}
+		}
+		line = get_next_line(line, false);
+	}
+	return { false, NO_FLIP, 0 };
 }
 
 /*
@@ -195,56 +366,20 @@ void problem_1::solve(const std::string& file_name)
 		return;
 	}
 
-	common_setup();
-
-	// Loop through until we run into a line we've visited before
-	while (!input.eof()) {
-		if (Visited_lines[Current_line]) {
-			break;
-		}
-		Visited_lines[Current_line] = true;
-		interpret_next_line(&input, false);
-	}
+	const handheld_console console(input);
 	input.close();
 
-	std::string answer;
-	answer = std::to_string(Accumulator);
-	output_answer(answer);
-}
+	const run_result result = console.run();
 
-// Reverse the state to before the most recent line we can flip
-//
-// input:	The input to reverse
-void reverse_to_before_flip_line(std::ifstream* input) 
-{
-	frame cur_frame = Frame_stack.top();	
-	// Undo any previous flip
-	if (Line_flipped != -1) {
-		// Remove frames until the one where we flipped
-		while (cur_frame.m_line != Line_flipped) {
-			Frame_stack.pop();
-			cur_frame = Frame_stack.top();
-		}
-		Frame_stack.pop();
-		cur_frame = Frame_stack.top();
-	}
-
-	// Move input back to position
-	input->seekg(cur_frame.m_pos);
-	int inst_crc = 0;
-	int arg = 0;
-	get_instruction(&inst_crc, &arg, *input);	
-
-	// Don't care about accumulator instructions or when flipping does nothing
-	while (inst_crc == INST_ACC_CRC || arg == 0) {
-		Frame_stack.pop();
-		cur_frame = Frame_stack.top();
-		input->seekg(cur_frame.m_pos);
-		get_instruction(&inst_crc, &arg, *input);
+	if (TRACE_EXECUTION) {
+		execution_trace trace(console.get_num_lines());
+		console.run(NO_FLIP, trace);
+		console.write_trace(trace, file_name + '.' + std::to_string(m_problem_number) + TRACE_FILE_SUFFIX);
 	}
 
-	Accumulator = cur_frame.m_acc;
-	Current_line = cur_frame.m_line;
+	std::string answer;
+	answer = std::to_string(result.m_accumulator);
+	output_answer(answer);
 }
 
 /*
@@ -261,31 +396,21 @@ void problem_2::solve(const std::string& file_name)
 		return;
 	}
 
-	common_setup();
-
-	while (!input.eof()) {
-		bool flip = false;
-		// Once we've found a line we've visited
-		if (Visited_lines[Current_line]) {
-			// Something went wrong
-			// Reverse what's happened to before we made the last jmp or nop
-			reverse_to_before_flip_line(&input);
-			Line_flipped = Current_line;
-			// Make the next instruction be flipped
-			flip = true;
-		}
+	const handheld_console console(input);
+	input.close();
 
-		Visited_lines[Current_line] = true;
-		if (!flip) {
-			// If we didn't just revert, then add this to the stack
-			Frame_stack.emplace(frame(Accumulator, Current_line, input.tellg()));
-		}
-		interpret_next_line(&input, flip);
+	const repair_result repair = console.find_repair();
+	if (!repair.m_found) {
+		return;
 	}
 
-	input.close();
+	if (TRACE_EXECUTION) {
+		execution_trace trace(console.get_num_lines());
+		console.run(repair.m_flipped_line, trace);
+		console.write_trace(trace, file_name + '.' + std::to_string(m_problem_number) + TRACE_FILE_SUFFIX);
+	}
 
 	std::string answer;
-	answer = std::to_string(Accumulator);
+	answer = std::to_string(repair.m_accumulator);
 	output_answer(answer);
 }
\ No newline at end of file
@@ -2,161 +2,265 @@
 
 #include "../common_includes.h"
 
-#include <set>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <vector>
-#include <limits>
-#include <numeric>
-
-#undef max
-#undef min
 
 PROBLEM_CLASS_CPP(9);
 
-static int Preamble_length;
-static float* Current_preamble;
-static int Current_index;
-static std::set<float> Current_preamble_sorted;
-
-// Add the number to the preamble array and sorted set
+static constexpr size_t PREAMBLE_LENGTH = 25;
+// How many numbers back the contiguous range can start from the invalid number
+static constexpr size_t HISTORY_LENGTH = 1 << 16;
+static const char* const STDIN_FILE_NAME = "-";
+
+// The most recent numbers, kept both in arrival order and sorted
+// The window is small, so shifting the sorted array on each update is cheaper than any tree
+class xmas_window {
+public:
+	xmas_window(size_t length);
+
+	bool is_full() const { return m_sorted.size() == m_length; }
+	void add_number(long long num);
+	bool is_sum_of_pair(long long target) const;
+
+private:
+	size_t m_length;
+	// Ring buffer of the window in arrival order, m_oldest is the next to be replaced
+	std::vector<long long> m_ring;
+	size_t m_oldest = 0;
+	std::vector<long long> m_sorted;
+};
+
+// Create an empty window
 //
-// index:			(Output) The index in the array for this new preamble
-// target:			The new number
-// preamble:		The array to add to
-// preamble_size: The size of the array
-static void add_number_to_preamble(int* index, float target, float* preamble, int preamble_size)
+// length:	How many numbers the window holds
+xmas_window::xmas_window(size_t length) : m_length(length)
 {
-	// Remove the oldest preamble number
-	Current_preamble_sorted.erase(preamble[*index]);
-
-	// Add new one
-	Current_preamble_sorted.emplace(target);
-	preamble[*index] = target;
-	*index = (*index + 1) % preamble_size;
+	m_ring.reserve(length);
+	m_sorted.reserve(length);
 }
 
-// Determine if the number is the sum of any two numbers in the preamble
+// Add a number to the window, replacing the oldest once it's full
 //
-// target:				The sum to use
-// sorted_preamble:	The preamble to search
-static bool is_preamble(float target, std::set<float>& sorted_preamble)
+// num:	The new number
+void xmas_window::add_number(long long num)
 {
-	auto lower_iter = sorted_preamble.cbegin();
-	if (*lower_iter > target) {
-		return false;
+	if (m_ring.size() < m_length) {
+		m_ring.push_back(num);
+	} else {
+		// Remove the oldest number
+		m_sorted.erase(std::lower_bound(m_sorted.begin(), m_sorted.end(), m_ring[m_oldest]));
+		m_ring[m_oldest] = num;
+		m_oldest = (m_oldest + 1) % m_length;
 	}
+	m_sorted.insert(std::upper_bound(m_sorted.begin(), m_sorted.end(), num), num);
+}
 
-	if (*lower_iter + *(std::next(lower_iter, 1)) > target) {
+// Determine if the number is the sum of two numbers with different values in the window
+//
+// target:	The sum to search for
+//
+// Returns true if a pair sums to the target
+bool xmas_window::is_sum_of_pair(long long target) const
+{
+	if (m_sorted.size() < 2) {
 		return false;
 	}
 
-	auto upper_iter = sorted_preamble.crbegin();
-	if (*upper_iter + *(std::next(upper_iter, 1)) < target) {
+	size_t lower = 0;
+	size_t upper = m_sorted.size() - 1;
+	// Quick rejects for a target outside of every possible sum
+	if (m_sorted[lower] + m_sorted[lower + 1] > target || m_sorted[upper] + m_sorted[upper - 1] < target) {
 		return false;
 	}
 
 	// Search for the target sum
-	while (*lower_iter != *upper_iter) {
-		if (*lower_iter + *upper_iter == target) {
+	while (lower < upper && m_sorted[lower] != m_sorted[upper]) {
+		const long long sum = m_sorted[lower] + m_sorted[upper];
+		if (sum == target) {
 			return true;
-		} else if (*lower_iter + *upper_iter < target) {
-			++lower_iter;
+		} else if (sum < target) {
+			++lower;
 		} else {
-			++upper_iter;
+			--upper;
 		}
 	}
 
 	return false;
 }
 
-// Add the given number to the sum. If it goes over, remove the old numbers until we're under
+// Finds both the first invalid number and the encryption weakness in a single pass over a stream that can't be rewound
+// Only the last history_length numbers are kept, as a ring of prefix sums, so memory stays bounded however long the stream is
+// The prefix sums wrap around modulo 2^64, but differences between them are still exact for any range that sums to a long long
+// Once the invalid number is found, the range search walks the kept history then carries on with new numbers as they arrive
+// All numbers are expected to be positive so the range can be searched with two pointers
+class xmas_stream {
+public:
+	xmas_stream(size_t preamble_length, size_t history_length);
+
+	void read(std::istream& input);
+
+	bool m_found_invalid = false;
+	long long m_invalid_number = 0;
+	bool m_found_weakness = false;
+	long long m_weakness = 0;
+
+private:
+	void add_number(long long num);
+	void advance_range();
+	void drop_range_front();
+
+	uint64_t get_prefix_sum(unsigned long long index) const { return m_prefix_sums[index % m_prefix_sums.size()]; }
+	long long get_range_sum(unsigned long long begin, unsigned long long end) const { return static_cast<long long>(get_prefix_sum(end) - get_prefix_sum(begin)); }
+	long long get_number(unsigned long long index) const { return get_range_sum(index, index + 1); }
+	unsigned long long get_oldest_index() const { return m_num_count > m_history_length ? m_num_count - m_history_length : 0; }
+
+	xmas_window m_preamble;
+	size_t m_history_length;
+
+	// The sum of the first i numbers is at i % size, holding history_length + 1 sums so the last history_length numbers can be recovered
+	std::vector<uint64_t> m_prefix_sums;
+	unsigned long long m_num_count = 0;
+
+	// The contiguous range being searched is [m_range_begin, m_range_end) with monotonic deques of indices for its min and max
+	unsigned long long m_range_begin = 0;
+	unsigned long long m_range_end = 0;
+	std::deque<unsigned long long> m_range_mins;
+	std::deque<unsigned long long> m_range_maxes;
+};
+
+// Create the stream state
 //
-// nums:				(Output) Vector of the numbers to sum up
-// current_sum:	(Output) The current sum of the numbers
-// num:				The new number to add
-// target:			The target value
+// preamble_length:	How many previous numbers can be summed
+// history_length:	How many numbers to keep for the range search, at least the preamble length
+xmas_stream::xmas_stream(size_t preamble_length, size_t history_length) :
+	m_preamble(preamble_length), m_history_length(history_length > preamble_length ? history_length : preamble_length), m_prefix_sums(m_history_length + 1, 0)
+{
+}
+
+// Read numbers until both answers are found or the stream ends
 //
-// Returns true if the newly added number reaches the target
-static bool add_number_to_sum(std::vector<float>* nums, float* current_sum, float num , float target)
+// input:	Input to read from, whitespace seperated numbers
+void xmas_stream::read(std::istream& input)
 {
-	// Remove old entries until the new sum isn't over the target
-	std::size_t nums_to_erase = 0;
-	while (nums_to_erase < nums->size() && *current_sum + num > target) {
-		*current_sum -= ((*nums)[nums_to_erase++]);
+	long long num = 0;
+	while (!m_found_weakness && input >> num) {
+		add_number(num);
 	}
-	if (nums_to_erase != 0) {
-		nums->erase(nums->begin(), std::next(nums->begin(), nums_to_erase));
+}
+
+// Add the next number from the stream
+//
+// num:	The new number
+void xmas_stream::add_number(long long num)
+{
+	m_prefix_sums[(m_num_count + 1) % m_prefix_sums.size()] = get_prefix_sum(m_num_count) + static_cast<uint64_t>(num);
+	++m_num_count;
+
+	if (m_found_invalid) {
+		advance_range();
+		return;
 	}
 
-	// Add new number
-	nums->emplace_back(num);
-	*current_sum += num;
+	if (m_preamble.is_full() && !m_preamble.is_sum_of_pair(num)) {
+		m_found_invalid = true;
+		m_invalid_number = num;
+		// Start the range search from the oldest number still kept
+		m_range_begin = m_range_end = get_oldest_index();
+		advance_range();
+		return;
+	}
+	m_preamble.add_number(num);
+}
 
-	return *current_sum == target;
+// Remove the first number of the range
+void xmas_stream::drop_range_front()
+{
+	++m_range_begin;
+	if (!m_range_mins.empty() && m_range_mins.front() < m_range_begin) {
+		m_range_mins.pop_front();
+	}
+	if (!m_range_maxes.empty() && m_range_maxes.front() < m_range_begin) {
+		m_range_maxes.pop_front();
+	}
 }
 
-// Setup global variables
-//
-// preamble:	Length of numbers for the preamble
-// input:		Input to read from
-static void common_setup(int preamble, std::ifstream* input)
+// Extend the range over every number read so far, shrinking it from the front whenever it sums past the invalid number
+void xmas_stream::advance_range()
 {
-	Current_index = 0;
-	Preamble_length = preamble;
-	Current_preamble = new float[Preamble_length];
-	Current_preamble_sorted.clear();
-
-	// Setup preamble
-	for (int i = 0; i < Preamble_length; ++i) {
-		std::string input_line;
-		std::getline(*input, input_line);
-		float target = std::stof(input_line);
-		Current_preamble[i] = target;
-		Current_preamble_sorted.emplace(target);
+	while (!m_found_weakness && m_range_end < m_num_count) {
+		// Keep the deques increasing for the min and decreasing for the max so their fronts are always the answer
+		const long long num = get_number(m_range_end);
+		while (!m_range_mins.empty() && get_number(m_range_mins.back()) >= num) {
+			m_range_mins.pop_back();
+		}
+		m_range_mins.push_back(m_range_end);
+		while (!m_range_maxes.empty() && get_number(m_range_maxes.back()) <= num) {
+			m_range_maxes.pop_back();
+		}
+		m_range_maxes.push_back(m_range_end);
+		++m_range_end;
+
+		// Numbers older than the history are about to be overwritten, so they have to leave the range as well
+		while (m_range_begin < m_range_end && (get_range_sum(m_range_begin, m_range_end) > m_invalid_number || m_range_begin < get_oldest_index())) {
+			drop_range_front();
+		}
+
+		if (m_range_end - m_range_begin >= 2 && get_range_sum(m_range_begin, m_range_end) == m_invalid_number) {
+			m_found_weakness = true;
+			m_weakness = get_number(m_range_mins.front()) + get_number(m_range_maxes.front());
+		}
 	}
 }
 
-// Clear global variables
-static void common_destruct()
+// Read the XMAS data for one part
+// A file is read again for each part, but stdin can only be read once so the first part to ask keeps it for the other
+//
+// file_name:	The file to read, or "-" for stdin
+// file_xmas:	(Output) The stream state to read a file into
+//
+// Returns the stream state, or nullptr if the input couldn't be opened
+static const xmas_stream* get_xmas(const std::string& file_name, xmas_stream* file_xmas)
 {
-	delete[] Current_preamble;
+	if (file_name == STDIN_FILE_NAME) {
+		static std::unique_ptr<xmas_stream> stdin_xmas;
+		if (stdin_xmas == nullptr) {
+			stdin_xmas = std::make_unique<xmas_stream>(PREAMBLE_LENGTH, HISTORY_LENGTH);
+			stdin_xmas->read(std::cin);
+		}
+		return stdin_xmas.get();
+	}
+
+	std::ifstream input(file_name);
+
+	if (!input.is_open()) {
+		return nullptr;
+	}
+
+	file_xmas->read(input);
+	input.close();
+	return file_xmas;
 }
 
 /*
-* Transmits a preamble of 25 numbers. After that, each number you receive should be the sum 
+* Transmits a preamble of 25 numbers. After that, each number you receive should be the sum
 * of any two of the 25 immediately previous numbers. The two numbers will have different values, and there might be more than one such pair.
 */
 
 //  What is the first number that does not have this property
 void problem_1::solve(const std::string& file_name)
 {
-	std::ifstream input(file_name);
-
-	if (!input.is_open()) {
+	xmas_stream file_xmas(PREAMBLE_LENGTH, HISTORY_LENGTH);
+	const xmas_stream* xmas = get_xmas(file_name, &file_xmas);
+	if (xmas == nullptr || !xmas->m_found_invalid) {
 		return;
 	}
 
-	common_setup(25, &input);
-
-	float target = 0;
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		target = std::stof(input_line);
-
-		if (!is_preamble(target, Current_preamble_sorted)) {
-			break;
-		}		
-
-		add_number_to_preamble(&Current_index, target, Current_preamble, Preamble_length);
-	}
-
-	input.close();
-
-	common_destruct();
-
 	std::string answer;
-	answer = std::to_string(target);
-	output_answer(answer); 
+	answer = std::to_string(xmas->m_invalid_number);
+	output_answer(answer);
 }
 
 /*
@@ -167,59 +271,13 @@ void problem_1::solve(const std::string& file_name)
 // What is the encryption weakness in your XMAS-encrypted list of numbers
 void problem_2::solve(const std::string& file_name)
 {
-	std::ifstream input(file_name);
-
-	if (!input.is_open()) {
+	xmas_stream file_xmas(PREAMBLE_LENGTH, HISTORY_LENGTH);
+	const xmas_stream* xmas = get_xmas(file_name, &file_xmas);
+	if (xmas == nullptr || !xmas->m_found_weakness) {
 		return;
 	}
 
-	common_setup(25, &input);
-
-	float target = 0;
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		target = std::stof(input_line);
-
-		if (!is_preamble(target, Current_preamble_sorted)) {
-			break;
-		}
-
-		add_number_to_preamble(&Current_index, target, Current_preamble, Preamble_length);
-	}
-
-	// Reset input
-	input.seekg(0, std::ios_base::beg);
-
-	// Add each number to the sum until it equals the invalid number
-	std::vector<float> sum;
-	float current_sum = 0;
-	while (!input.eof()) {
-		std::string input_line;
-		std::getline(input, input_line);
-		float num = std::stof(input_line);
-
-		if (add_number_to_sum(&sum, &current_sum, num, target)) {
-			break;
-		}
-	}
-
-	input.close(); 
-
-	float lower = std::numeric_limits<float>::max();
-	float upper = std::numeric_limits<float>::min();
-	for (const auto& num : sum) {
-		if (num < lower) {
-			lower = num;
-		}
-		if (num > upper) {
-			upper = num;
-		}
-	}
-
-	common_destruct();
-
 	std::string answer;
-	answer = std::to_string(lower + upper);
+	answer = std::to_string(xmas->m_weakness);
 	output_answer(answer);
 }
\ No newline at end of file
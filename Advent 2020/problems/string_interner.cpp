@@ -0,0 +1,190 @@
+#include "string_interner.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr string_interner::id string_interner::INVALID_ID;
+
+// Smallest arena block, longer strings get a block of their own
+static constexpr size_t ARENA_BLOCK_SIZE = 1 << 14;
+
+// Create an empty interner
+//
+// expected_strings:	How many strings to size the table for up front
+string_interner::string_interner(size_t expected_strings)
+{
+	size_t num_slots = 16;
+	while (num_slots < expected_strings * 2) {
+		num_slots <<= 1;
+	}
+	m_slots.assign(num_slots, INVALID_ID);
+	m_entries.reserve(expected_strings);
+}
+
+// FNV-1a hash of a string
+//
+// chars:	The first character
+// length:	Number of characters
+//
+// Returns the hash
+uint32_t string_interner::hash(const char* chars, size_t length)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= static_cast<unsigned char>(chars[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Linear probe for a string's slot
+//
+// chars:	The first character
+// length:	Number of characters
+// hash:	Hash of the string
+//
+// Returns the slot holding the string, or the empty slot it would go in
+size_t string_interner::find_slot(const char* chars, size_t length, uint32_t hash) const
+{
+	const size_t slot_mask = m_slots.size() - 1;
+	size_t slot = hash & slot_mask;
+	while (m_slots[slot] != INVALID_ID) {
+		const entry& cur_entry = m_entries[m_slots[slot]];
+		if (cur_entry.m_hash == hash && cur_entry.m_length == length && std::memcmp(cur_entry.m_chars, chars, length) == 0) {
+			return slot;
+		}
+		slot = (slot + 1) & slot_mask;
+	}
+	return slot;
+}
+
+// Copy a string into the arena
+//
+// chars:	The first character
+// length:	Number of characters
+//
+// Returns where the string was copied to
+const char* string_interner::store(const char* chars, size_t length)
+{
+	// Nothing to copy, and the arena may not have a block yet
+	if (length == 0) {
+		return "";
+	}
+
+	if (length > m_arena_remaining) {
+		const size_t block_size = std::max(length, ARENA_BLOCK_SIZE);
+		m_arena_blocks.emplace_back(new char[block_size]);
+		m_arena_pos = m_arena_blocks.back().get();
+		m_arena_remaining = block_size;
+	}
+
+	char* stored = m_arena_pos;
+	std::memcpy(stored, chars, length);
+	m_arena_pos += length;
+	m_arena_remaining -= length;
+	return stored;
+}
+
+// Double the table and reinsert every entry using its saved hash
+void string_interner::grow_table()
+{
+	m_slots.assign(m_slots.size() * 2, INVALID_ID);
+	const size_t slot_mask = m_slots.size() - 1;
+	for (id entry_id = 0; entry_id < static_cast<id>(m_entries.size()); ++entry_id) {
+		size_t slot = m_entries[entry_id].m_hash & slot_mask;
+		while (m_slots[slot] != INVALID_ID) {
+			slot = (slot + 1) & slot_mask;
+		}
+		m_slots[slot] = entry_id;
+	}
+}
+
+// Get the id for a string, adding it if it's new
+//
+// chars:	The first character
+// length:	Number of characters
+//
+// Returns the string's id
+string_interner::id string_interner::intern(const char* chars, size_t length)
+{
+	const uint32_t string_hash = hash(chars, length);
+	size_t slot = find_slot(chars, length, string_hash);
+	if (m_slots[slot] != INVALID_ID) {
+		return m_slots[slot];
+	}
+
+	// Keep the table at most half full so probes stay short
+	if ((m_entries.size() + 1) * 2 > m_slots.size()) {
+		grow_table();
+		slot = find_slot(chars, length, string_hash);
+	}
+
+	const id new_id = static_cast<id>(m_entries.size());
+	m_entries.push_back({ store(chars, length), static_cast<uint32_t>(length), string_hash });
+	m_slots[slot] = new_id;
+	return new_id;
+}
+
+// Get the id for a string without adding it
+//
+// chars:	The first character
+// length:	Number of characters
+//
+// Returns the string's id, or INVALID_ID if it was never interned
+string_interner::id string_interner::find(const char* chars, size_t length) const
+{
+	return m_slots[find_slot(chars, length, hash(chars, length))];
+}
+
+// Move past any spaces
+void word_tokenizer::skip_spaces()
+{
+	while (m_pos != m_end && *m_pos == ' ') {
+		++m_pos;
+	}
+}
+
+// Get the next word
+//
+// word:	(Output) The first character of the word
+// length:	(Output) Number of characters in the word
+//
+// Returns true if a word was found
+bool word_tokenizer::next_word(const char** word, size_t* length)
+{
+	return next_words(1, word, length);
+}
+
+// Get the next few words as a single span, such as an "adjective colour" pair
+//
+// num_words:	How many words to include
+// words:		(Output) The first character of the first word
+// length:		(Output) Number of characters from the first word to the end of the last, including the spaces between
+//
+// Returns true if all the words were found
+bool word_tokenizer::next_words(int num_words, const char** words, size_t* length)
+{
+	skip_spaces();
+	const char* start = m_pos;
+	for (int i = 0; i < num_words; ++i) {
+		skip_spaces();
+		if (m_pos == m_end) {
+			return false;
+		}
+		while (m_pos != m_end && *m_pos != ' ') {
+			++m_pos;
+		}
+	}
+	*words = start;
+	*length = static_cast<size_t>(m_pos - start);
+	return true;
+}
+
+// Check if there are no more words
+//
+// Returns true if only spaces remain
+bool word_tokenizer::at_end()
+{
+	skip_spaces();
+	return m_pos == m_end;
+}
\ No newline at end of file
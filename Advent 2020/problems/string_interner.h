@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Assigns dense ids to strings, starting from 0 in the order they are first seen
+// Strings are copied once into an arena and looked up through an open addressing hash table,
+// so interning a name that already exists never allocates
+class string_interner {
+public:
+	typedef int id;
+	static constexpr id INVALID_ID = -1;
+
+	string_interner(size_t expected_strings = 64);
+
+	id intern(const char* chars, size_t length);
+	id intern(const std::string& str) { return intern(str.data(), str.size()); }
+	id find(const char* chars, size_t length) const;
+	id find(const std::string& str) const { return find(str.data(), str.size()); }
+
+	size_t size() const { return m_entries.size(); }
+	const char* get_chars(id string_id) const { return m_entries[string_id].m_chars; }
+	size_t get_length(id string_id) const { return m_entries[string_id].m_length; }
+	std::string get_string(id string_id) const { return std::string(get_chars(string_id), get_length(string_id)); }
+
+private:
+	// Where an interned string lives in the arena
+	struct entry {
+		const char* m_chars;
+		uint32_t m_length;
+		uint32_t m_hash;
+	};
+
+	static uint32_t hash(const char* chars, size_t length);
+
+	size_t find_slot(const char* chars, size_t length, uint32_t hash) const;
+	const char* store(const char* chars, size_t length);
+	void grow_table();
+
+	std::vector<entry> m_entries;
+	// Each slot is an index into m_entries or INVALID_ID when empty, the size is always a power of 2
+	std::vector<id> m_slots;
+
+	std::vector<std::unique_ptr<char[]>> m_arena_blocks;
+	char* m_arena_pos = nullptr;
+	size_t m_arena_remaining = 0;
+};
+
+// Splits text into space seperated words without copying
+class word_tokenizer {
+public:
+	word_tokenizer(const char* begin, const char* end) : m_pos(begin), m_end(end) {};
+	word_tokenizer(const std::string& text) : word_tokenizer(text.data(), text.data() + text.size()) {};
+
+	bool next_word(const char** word, size_t* length);
+	bool next_words(int num_words, const char** words, size_t* length);
+	bool at_end();
+
+private:
+	void skip_spaces();
+
+	const char* m_pos;
+	const char* m_end;
+};
\ No newline at end of file